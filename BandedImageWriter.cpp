@@ -0,0 +1,469 @@
+/***************************************************************************
+ *                                                                         *
+ *   This file is part of the FotoWall project,                            *
+ *       http://code.google.com/p/fotowall                                 *
+ *                                                                         *
+ *   Copyright (C) 2009 by Enrico Ros <enrico.ros@gmail.com>               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "BandedImageWriter.h"
+#include "RenderSnapshot.h"
+#include <QDataStream>
+#include <QFileInfo>
+#include <QtConcurrentMap>
+#include <string.h>
+#ifdef HAS_ZLIB
+#include <zlib.h>
+#endif
+
+#define BAND_BYTES (32 * 1024 * 1024)
+#define STRIP_ROWS 32
+#define IDAT_SIZE (64 * 1024)
+
+BandedImageWriter::BandedImageWriter(const QString & fileName)
+    : m_fileName(fileName)
+    , m_format(formatFor(fileName))
+    , m_bandHeight(0)
+    , m_rowsWritten(0)
+    , m_ok(false)
+    , m_bigTiff(false)
+    , m_stripRows(0)
+    , m_zStream(0)
+{
+}
+
+BandedImageWriter::~BandedImageWriter()
+{
+    if (m_ok)
+        abort();
+}
+
+bool BandedImageWriter::canWrite(const QString & fileName)
+{
+    return formatFor(fileName) != Unknown;
+}
+
+BandedImageWriter::Format BandedImageWriter::formatFor(const QString & fileName)
+{
+    const QString suffix = QFileInfo(fileName).suffix().toLower();
+    if (suffix == "tif" || suffix == "tiff")
+        return Tiff;
+#ifdef HAS_ZLIB
+    if (suffix == "png")
+        return Png;
+#endif
+    return Unknown;
+}
+
+bool BandedImageWriter::write(const RenderSnapshot & snapshot, int bandHeight)
+{
+    const QSize size = snapshot.size();
+    if (size.isEmpty())
+        return false;
+    if (bandHeight < 1) {
+        bandHeight = qBound(1, (int)(BAND_BYTES / ((qint64)size.width() * 4)), size.height());
+        if (bandHeight > STRIP_ROWS)
+            bandHeight -= bandHeight % STRIP_ROWS;
+    }
+    if (!begin(size, bandHeight))
+        return false;
+    for (int y = 0; y < size.height(); y += bandHeight) {
+        const QImage band = snapshot.toImage(QRect(0, y, size.width(), qMin(bandHeight, size.height() - y)));
+        if (!writeBand(band))
+            return false;
+    }
+    return end();
+}
+
+bool BandedImageWriter::begin(const QSize & size, int bandHeight)
+{
+    if (m_ok || m_format == Unknown || size.isEmpty() || bandHeight < 1)
+        return false;
+    m_size = size;
+    m_bandHeight = bandHeight;
+    m_rowsWritten = 0;
+    m_file.setFileName(m_fileName + ".part");
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+    m_ok = true;
+    const bool started = m_format == Tiff ? beginTiff() : beginPng();
+    if (!started)
+        abort();
+    return started;
+}
+
+bool BandedImageWriter::writeBand(const QImage & band)
+{
+    if (!m_ok)
+        return false;
+    const int rows = band.height();
+    const bool last = m_rowsWritten + rows == m_size.height();
+    if (band.width() != m_size.width() || rows < 1 || rows > m_bandHeight || (!last && rows != m_bandHeight)
+        || m_rowsWritten + rows > m_size.height()) {
+        qWarning("BandedImageWriter::writeBand: band of %dx%d doesn't fit", band.width(), rows);
+        abort();
+        return false;
+    }
+    const QImage pixels = band.format() == QImage::Format_ARGB32 ? band : band.convertToFormat(QImage::Format_ARGB32);
+    const bool written = m_format == Tiff ? writeTiffBand(pixels) : writePngBand(pixels);
+    if (!written || m_file.error() != QFile::NoError) {
+        abort();
+        return false;
+    }
+    m_rowsWritten += rows;
+    return true;
+}
+
+bool BandedImageWriter::end()
+{
+    if (!m_ok)
+        return false;
+    if (m_rowsWritten != m_size.height()) {
+        abort();
+        return false;
+    }
+    const bool ended = m_format == Tiff ? endTiff() : endPng();
+    m_file.close();
+    if (!ended || m_file.error() != QFile::NoError) {
+        abort();
+        return false;
+    }
+
+    // replace the previous file only now
+    QFile::remove(m_fileName);
+    if (!QFile::rename(m_file.fileName(), m_fileName)) {
+        abort();
+        return false;
+    }
+    m_ok = false;
+    return true;
+}
+
+void BandedImageWriter::abort()
+{
+#ifdef HAS_ZLIB
+    if (m_zStream) {
+        deflateEnd((z_stream *)m_zStream);
+        delete (z_stream *)m_zStream;
+        m_zStream = 0;
+    }
+#endif
+    m_file.close();
+    QFile::remove(m_file.fileName());
+    m_ok = false;
+}
+
+
+/// TIFF
+struct TiffStrip {
+    const QImage * band;
+    int first;
+    int rows;
+};
+
+// RGBA rows with the horizontal predictor, deflated (as a zlib stream)
+static QByteArray packTiffStrip(const TiffStrip & strip)
+{
+    const int width = strip.band->width();
+    QByteArray data;
+    data.resize(width * 4 * strip.rows);
+    uchar * out = (uchar *)data.data();
+    for (int y = strip.first; y < strip.first + strip.rows; ++y) {
+        const QRgb * line = (const QRgb *)strip.band->scanLine(y);
+        QRgb previous = 0;
+        for (int x = 0; x < width; ++x) {
+            const QRgb pixel = line[x];
+            *out++ = qRed(pixel) - qRed(previous);
+            *out++ = qGreen(pixel) - qGreen(previous);
+            *out++ = qBlue(pixel) - qBlue(previous);
+            *out++ = qAlpha(pixel) - qAlpha(previous);
+            previous = pixel;
+        }
+    }
+
+    // qCompress prepends the size of the data to the stream
+    return qCompress(data, 6).mid(4);
+}
+
+static void writeTiffEntry(QDataStream & out, bool big, quint16 tag, quint16 type, quint64 count, quint64 value)
+{
+    out << tag << type;
+    if (big)
+        out << count << value;
+    else
+        out << (quint32)count << (quint32)value;
+}
+
+bool BandedImageWriter::beginTiff()
+{
+    // the worst case of deflate, plus the tables: over 4GB needs 64 bit offsets
+    const qint64 raw = (qint64)m_size.width() * m_size.height() * 4;
+    m_bigTiff = raw + raw / 64 + (1 << 20) > (qint64)0xffffffffLL;
+    m_stripRows = (m_bandHeight % STRIP_ROWS) ? m_bandHeight : STRIP_ROWS;
+    m_stripOffsets.clear();
+    m_stripCounts.clear();
+
+    // the offset of the directory is set at the end
+    QDataStream out(&m_file);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out.writeRawData("II", 2);
+    if (m_bigTiff)
+        out << (quint16)43 << (quint16)8 << (quint16)0 << (quint64)0;
+    else
+        out << (quint16)42 << (quint32)0;
+    return m_file.error() == QFile::NoError;
+}
+
+bool BandedImageWriter::writeTiffBand(const QImage & band)
+{
+    QList<TiffStrip> strips;
+    for (int first = 0; first < band.height(); first += m_stripRows) {
+        TiffStrip strip;
+        strip.band = &band;
+        strip.first = first;
+        strip.rows = qMin(m_stripRows, band.height() - first);
+        strips.append(strip);
+    }
+
+    // deflate on all the cores, write in order
+    const QList<QByteArray> packed = QtConcurrent::blockingMapped<QList<QByteArray> >(strips, packTiffStrip);
+    foreach (const QByteArray & data, packed) {
+        m_stripOffsets.append(m_file.pos());
+        m_stripCounts.append(data.size());
+        if (m_file.write(data) != data.size())
+            return false;
+    }
+    return true;
+}
+
+bool BandedImageWriter::endTiff()
+{
+    QDataStream out(&m_file);
+    out.setByteOrder(QDataStream::LittleEndian);
+    const int strips = m_stripOffsets.size();
+    const quint16 longType = m_bigTiff ? 16 : 4;    // LONG8 or LONG
+
+    // the values that don't fit in the entries, word aligned
+    if (m_file.pos() & 1)
+        out << (quint8)0;
+    quint64 bitsValue = 8 | (8 << 16) | ((quint64)8 << 32) | ((quint64)8 << 48);
+    if (!m_bigTiff) {
+        bitsValue = m_file.pos();
+        out << (quint16)8 << (quint16)8 << (quint16)8 << (quint16)8;
+    }
+    quint64 offsetsValue = m_stripOffsets.first();
+    quint64 countsValue = m_stripCounts.first();
+    if (strips > 1) {
+        offsetsValue = m_file.pos();
+        foreach (quint64 offset, m_stripOffsets) {
+            if (m_bigTiff)
+                out << offset;
+            else
+                out << (quint32)offset;
+        }
+        countsValue = m_file.pos();
+        foreach (quint64 count, m_stripCounts) {
+            if (m_bigTiff)
+                out << count;
+            else
+                out << (quint32)count;
+        }
+    }
+
+    // the directory, entries sorted by tag
+    const quint64 directoryOffset = m_file.pos();
+    if (m_bigTiff)
+        out << (quint64)12;
+    else
+        out << (quint16)12;
+    writeTiffEntry(out, m_bigTiff, 256, 4, 1, m_size.width());         // ImageWidth
+    writeTiffEntry(out, m_bigTiff, 257, 4, 1, m_size.height());        // ImageLength
+    writeTiffEntry(out, m_bigTiff, 258, 3, 4, bitsValue);              // BitsPerSample
+    writeTiffEntry(out, m_bigTiff, 259, 3, 1, 8);                      // Compression: deflate
+    writeTiffEntry(out, m_bigTiff, 262, 3, 1, 2);                      // Photometric: RGB
+    writeTiffEntry(out, m_bigTiff, 273, longType, strips, offsetsValue); // StripOffsets
+    writeTiffEntry(out, m_bigTiff, 277, 3, 1, 4);                      // SamplesPerPixel
+    writeTiffEntry(out, m_bigTiff, 278, 4, 1, m_stripRows);            // RowsPerStrip
+    writeTiffEntry(out, m_bigTiff, 279, longType, strips, countsValue); // StripByteCounts
+    writeTiffEntry(out, m_bigTiff, 284, 3, 1, 1);                      // PlanarConfiguration: chunky
+    writeTiffEntry(out, m_bigTiff, 317, 3, 1, 2);                      // Predictor: horizontal
+    writeTiffEntry(out, m_bigTiff, 338, 3, 1, 2);                      // ExtraSamples: unassociated alpha
+    if (m_bigTiff)
+        out << (quint64)0;
+    else
+        out << (quint32)0;
+
+    // point the header to the directory
+    if (!m_file.seek(m_bigTiff ? 8 : 4))
+        return false;
+    if (m_bigTiff)
+        out << directoryOffset;
+    else
+        out << (quint32)directoryOffset;
+    return m_file.error() == QFile::NoError;
+}
+
+
+/// PNG
+#ifdef HAS_ZLIB
+static inline int paethPredictor(int a, int b, int c)
+{
+    const int p = a + b - c;
+    const int pa = qAbs(p - a);
+    const int pb = qAbs(p - b);
+    const int pc = qAbs(p - c);
+    if (pa <= pb && pa <= pc)
+        return a;
+    return pb <= pc ? b : c;
+}
+
+// the filter giving the smallest sum of the (signed) bytes, as libpng does;
+// 'out' gets the type and the filtered row
+static void filterPngRow(const uchar * row, const uchar * above, int length, uchar * scratch, uchar * out)
+{
+    static const int types[4] = { 0, 1, 2, 4 };     // None, Sub, Up, Paeth
+    uchar * none = scratch;
+    uchar * sub = scratch + length;
+    uchar * up = scratch + 2 * length;
+    uchar * paeth = scratch + 3 * length;
+    qint64 sums[4] = { 0, 0, 0, 0 };
+    for (int i = 0; i < length; ++i) {
+        const int left = i >= 4 ? row[i - 4] : 0;
+        const int upperLeft = i >= 4 ? above[i - 4] : 0;
+        none[i] = row[i];
+        sub[i] = row[i] - left;
+        up[i] = row[i] - above[i];
+        paeth[i] = row[i] - paethPredictor(left, above[i], upperLeft);
+        sums[0] += qAbs((signed char)none[i]);
+        sums[1] += qAbs((signed char)sub[i]);
+        sums[2] += qAbs((signed char)up[i]);
+        sums[3] += qAbs((signed char)paeth[i]);
+    }
+    int best = 0;
+    for (int i = 1; i < 4; ++i)
+        if (sums[i] < sums[best])
+            best = i;
+    out[0] = types[best];
+    memcpy(out + 1, scratch + best * length, length);
+}
+#endif
+
+bool BandedImageWriter::beginPng()
+{
+#ifdef HAS_ZLIB
+    if (m_file.write("\x89PNG\r\n\x1a\n", 8) != 8)
+        return false;
+    QByteArray header;
+    QDataStream out(&header, QIODevice::WriteOnly);
+    out << (quint32)m_size.width() << (quint32)m_size.height();
+    out << (quint8)8 << (quint8)6 << (quint8)0 << (quint8)0 << (quint8)0;    // 8 bit RGBA, not interlaced
+    if (!writePngChunk("IHDR", header))
+        return false;
+
+    z_stream * stream = new z_stream;
+    memset(stream, 0, sizeof(z_stream));
+    if (deflateInit(stream, 6) != Z_OK) {
+        delete stream;
+        return false;
+    }
+    m_zStream = stream;
+    m_previousRow = QByteArray(m_size.width() * 4, 0);
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool BandedImageWriter::writePngBand(const QImage & band)
+{
+#ifdef HAS_ZLIB
+    const int width = band.width();
+    const int length = width * 4;
+    QByteArray row(length, 0);
+    QByteArray scratch(4 * length, 0);
+    QByteArray filtered;
+    filtered.resize(band.height() * (length + 1));
+    for (int y = 0; y < band.height(); ++y) {
+        const QRgb * line = (const QRgb *)band.scanLine(y);
+        uchar * rgba = (uchar *)row.data();
+        for (int x = 0; x < width; ++x) {
+            *rgba++ = qRed(line[x]);
+            *rgba++ = qGreen(line[x]);
+            *rgba++ = qBlue(line[x]);
+            *rgba++ = qAlpha(line[x]);
+        }
+        filterPngRow((const uchar *)row.constData(), (const uchar *)m_previousRow.constData(), length,
+                     (uchar *)scratch.data(), (uchar *)filtered.data() + y * (length + 1));
+        qSwap(row, m_previousRow);
+    }
+    return deflatePng(filtered, false);
+#else
+    Q_UNUSED(band);
+    return false;
+#endif
+}
+
+bool BandedImageWriter::endPng()
+{
+#ifdef HAS_ZLIB
+    if (!deflatePng(QByteArray(), true))
+        return false;
+    deflateEnd((z_stream *)m_zStream);
+    delete (z_stream *)m_zStream;
+    m_zStream = 0;
+    return writePngChunk("IEND", QByteArray());
+#else
+    return false;
+#endif
+}
+
+bool BandedImageWriter::deflatePng(const QByteArray & data, bool finish)
+{
+#ifdef HAS_ZLIB
+    z_stream * stream = (z_stream *)m_zStream;
+    stream->next_in = (Bytef *)data.constData();
+    stream->avail_in = data.size();
+    QByteArray chunk(IDAT_SIZE, 0);
+    forever {
+        stream->next_out = (Bytef *)chunk.data();
+        stream->avail_out = chunk.size();
+        const int result = deflate(stream, finish ? Z_FINISH : Z_NO_FLUSH);
+        if (result == Z_STREAM_ERROR)
+            return false;
+        const int produced = chunk.size() - stream->avail_out;
+        if (produced > 0 && !writePngChunk("IDAT", chunk.left(produced)))
+            return false;
+        // all the input taken, or the stream closed
+        if (finish ? result == Z_STREAM_END : stream->avail_out != 0)
+            return true;
+    }
+#else
+    Q_UNUSED(data);
+    Q_UNUSED(finish);
+    return false;
+#endif
+}
+
+bool BandedImageWriter::writePngChunk(const char * type, const QByteArray & data)
+{
+#ifdef HAS_ZLIB
+    uLong crc = crc32(0L, (const Bytef *)type, 4);
+    crc = crc32(crc, (const Bytef *)data.constData(), data.size());
+    QDataStream out(&m_file);
+    out << (quint32)data.size();
+    m_file.write(type, 4);
+    m_file.write(data);
+    out << (quint32)crc;
+    return m_file.error() == QFile::NoError;
+#else
+    Q_UNUSED(type);
+    Q_UNUSED(data);
+    return false;
+#endif
+}
@@ -0,0 +1,90 @@
+/***************************************************************************
+ *                                                                         *
+ *   This file is part of the FotoWall project,                            *
+ *       http://code.google.com/p/fotowall                                 *
+ *                                                                         *
+ *   Copyright (C) 2009 by Enrico Ros <enrico.ros@gmail.com>               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __BandedImageWriter_h__
+#define __BandedImageWriter_h__
+
+#include <QFile>
+#include <QImage>
+#include <QList>
+#include <QSize>
+#include <QString>
+class RenderSnapshot;
+
+/**
+    \brief Writes an image to a PNG or TIFF file a band of rows at a time
+
+    The bands are encoded as they come, so the memory in use is a band, the
+    recording (without the full-resolution pixels: see drawSource() in
+    RenderSnapshot) and the sources the replay of a band loads, within the
+    ImageCache budget: not the size of the image. TIFF files are RGBA strips, deflated in
+    parallel (BigTIFF when they could exceed 4GB); PNG files are a single
+    deflate stream, so they need zlib (HAS_ZLIB): without it canWrite() is
+    false for them, and they are saved from a whole image in memory.
+    The file is written aside and renamed at the end.
+*/
+class BandedImageWriter
+{
+    public:
+        BandedImageWriter(const QString & fileName);
+        ~BandedImageWriter();
+
+        // true if the format of the file (by suffix) can be streamed
+        static bool canWrite(const QString & fileName);
+
+        // render 'snapshot' a band at a time, and write it
+        bool write(const RenderSnapshot & snapshot, int bandHeight = 0);
+
+        // or feed the bands: all but the last have 'bandHeight' rows
+        bool begin(const QSize & size, int bandHeight);
+        bool writeBand(const QImage & band);
+        bool end();
+
+    private:
+        enum Format { Unknown, Png, Tiff };
+        static Format formatFor(const QString & fileName);
+        void abort();
+
+        // tiff
+        bool beginTiff();
+        bool writeTiffBand(const QImage & band);
+        bool endTiff();
+
+        // png
+        bool beginPng();
+        bool writePngBand(const QImage & band);
+        bool endPng();
+        bool deflatePng(const QByteArray & data, bool finish);
+        bool writePngChunk(const char * type, const QByteArray & data);
+
+        QString m_fileName;
+        Format m_format;
+        QFile m_file;
+        QSize m_size;
+        int m_bandHeight;
+        int m_rowsWritten;
+        bool m_ok;
+
+        // tiff
+        bool m_bigTiff;
+        int m_stripRows;
+        QList<quint64> m_stripOffsets;
+        QList<quint64> m_stripCounts;
+
+        // png
+        void * m_zStream;
+        QByteArray m_previousRow;
+};
+
+#endif
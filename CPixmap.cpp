@@ -20,45 +20,139 @@
  ******************************/
 
 #include "CPixmap.h"
-#include "GlowEffectWidget.h"
-#include <QImage>
+#include "ImageCache.h"
+#include "ThumbnailCache.h"
+#include "effects/EffectChain.h"
+#include <QHash>
+#include <QImageReader>
 
-CPixmap::CPixmap() {
+// larger pictures are decoded scaled down to this size for the display
+#define DISPLAY_MAX_SIDE 1600
+
+// ImageCache group of the original resolution images
+#define FULL_GROUP "cpixmap-full"
+
+static QString newMemoGroup() {
+    static int s_serial = 0;
+    return QString("cpixmap-%1").arg(++s_serial);
+}
+
+// the memo groups of files are shared by all the CPixmaps of the same file
+// contents: the original and the results of the same effects exist once
+struct SharedGroup {
+    int refs;
+    QSize fullSize;
+};
+typedef QHash<QString, SharedGroup> SharedGroups;
+Q_GLOBAL_STATIC(SharedGroups, s_sharedGroups)
+
+// previews (e.g. thumbnails) are not the pixels of the file: keep them apart
+static QString sharedMemoGroup(const QString &fileName, bool preview) {
+    const QString key = preview ? QString() : ThumbnailCache::fileKey(fileName);
+    return key.isEmpty() ? newMemoGroup() : "pixels-" + key;
+}
+
+CPixmap::CPixmap() : m_memoGroup(newMemoGroup()), m_scaledGroup(m_memoGroup + "-scaled"), m_hasAlpha(false) {
 }
 
-CPixmap::CPixmap(const QString &fileName) : QPixmap(fileName), m_filePath(fileName) {
+CPixmap::CPixmap(const QString &fileName, const QImage &decoded, const QSize &fullSize, bool preview)
+    : m_filePath(fileName), m_fullSize(fullSize), m_memoGroup(sharedMemoGroup(fileName, preview)), m_scaledGroup(newMemoGroup() + "-scaled"), m_hasAlpha(false) {
+    // the same contents may be around already
+    SharedGroups * groups = s_sharedGroups();
+    QImage original = decoded;
+    if (original.isNull())
+        original = ImageCache::instance()->find(memoKey(m_effects, 0));
+    if (!original.isNull() && !m_fullSize.isValid() && groups->contains(m_memoGroup))
+        m_fullSize = groups->value(m_memoGroup).fullSize;
+    if (original.isNull())
+        original = loadForDisplay(fileName, &m_fullSize);
+    if (!m_fullSize.isValid())
+        m_fullSize = original.size();
+    if (!original.isNull()) {
+        // a preview can't be decoded again from the file
+        if (preview)
+            m_original = original;
+        else
+            ImageCache::instance()->insert(memoKey(m_effects, 0), original);
+        m_size = original.size();
+        m_hasAlpha = original.hasAlphaChannel();
+    }
+    SharedGroup & group = (*groups)[m_memoGroup];
+    group.refs++;
+    group.fullSize = m_fullSize;
+}
+
+CPixmap::CPixmap(const QPixmap &pixmap)
+    : m_fullSize(pixmap.size()), m_memoGroup(newMemoGroup()), m_scaledGroup(m_memoGroup + "-scaled"), m_size(pixmap.size()), m_hasAlpha(pixmap.hasAlpha()), m_original(pixmap.toImage()) {
+}
+
+CPixmap::~CPixmap() {
+    ImageCache * cache = ImageCache::instance();
+    if (!cache)
+        return;
+    cache->removeGroup(m_scaledGroup);
+
+    // the shared pixels go with the last user
+    SharedGroups * groups = s_sharedGroups();
+    if (groups && groups->contains(m_memoGroup) && --(*groups)[m_memoGroup].refs > 0)
+        return;
+    if (groups)
+        groups->remove(m_memoGroup);
+    cache->removeGroup(m_memoGroup);
+    cache->removeGroup(QString(FULL_GROUP "/") + m_memoGroup);
 }
 
-CPixmap::CPixmap(const QPixmap &pixmap): QPixmap(pixmap){
+bool CPixmap::isNull() const {
+    return m_size.isEmpty();
+}
+
+int CPixmap::width() const {
+    return m_size.width();
+}
+
+int CPixmap::height() const {
+    return m_size.height();
+}
+
+QSize CPixmap::size() const {
+    return m_size;
+}
+
+bool CPixmap::hasAlpha() const {
+    return m_hasAlpha;
+}
+
+QImage CPixmap::toImage() {
+    if (isNull())
+        return QImage();
+    if (m_effects.isEmpty())
+        return originalImage();
+
+    // evicted: compute it again
+    const QString key = memoKey(m_effects, m_effects.size());
+    QImage image = ImageCache::instance()->find(key);
+    if (image.isNull()) {
+        image = computeEffects(m_effects);
+        ImageCache::instance()->insert(key, image);
+    }
+    return image;
 }
 
 void CPixmap::addEffect(const CEffect & effect) {
-    switch (effect.effect) {
-        case CEffect::ClearEffects:
-            clearEffects();
-            break;
-        case CEffect::FlipH:
-            toHFlip();
-            break;
-        case CEffect::FlipV:
-            toVFlip();
-            break;
-        case CEffect::InvertColors:
-            toInvertedColors();
-            break;
-        case CEffect::NVG:
-            toNVG();
-            break;
-        case CEffect::BlackAndWhite:
-            toBlackAndWhite();
-            break;
-        case CEffect::Glow:
-            toGlow((int)effect.param);
-            break;
-        case CEffect::Sepia:
-            toSepia();
-            break;
+    if (effect.effect == CEffect::ClearEffects) {
+        clearEffects();
+        return;
     }
+    m_effects.push_back(effect);
+    applyEffects();
+}
+
+void CPixmap::setEffects(const QList<CEffect> & effects) {
+    m_effects.clear();
+    foreach (const CEffect & effect, effects)
+        if (effect.effect != CEffect::ClearEffects)
+            m_effects.push_back(effect);
+    applyEffects();
 }
 
 QList<CEffect> CPixmap::effects() const {
@@ -66,128 +160,264 @@ QList<CEffect> CPixmap::effects() const {
 }
 
 void CPixmap::clearEffects() {
-    //Reload the image to remove the effects
-    if( !m_filePath.isEmpty() ) {
-        load(m_filePath);
-        m_effects.clear();
-    }
+    // Back to the pristine image, reloaded only if evicted from the cache
+    m_effects.clear();
+    applyEffects();
 }
 
 void CPixmap::toNVG() {
-    m_effects.push_back(CEffect::NVG);
-    QImage img = this->toImage();
-    QImage dest(img.size(), img.format());
-    QColor pixel;
-    for(int x=0; x<img.width();x++) {
-        for (int y=0; y<img.height(); y++) {
-            pixel = img.pixel(x, y);
-            unsigned int average = (pixel.green()+ pixel.red() + pixel.blue()) / 3;
-            pixel.setGreen(average);
-            pixel.setBlue(average);
-            pixel.setRed(average);
-            dest.setPixel(x,y,pixel.rgb());
-        }
-    }
-    updateImage(dest);
+    addEffect(CEffect::NVG);
 }
 
 void CPixmap::toInvertedColors() {
-    m_effects.push_back(CEffect::InvertColors);
-    QImage img = this->toImage();
-    img.invertPixels();
-    updateImage(img);
+    addEffect(CEffect::InvertColors);
 }
 
 void CPixmap::toHFlip() {
-    m_effects.push_back(CEffect::FlipH);
-    QImage img = this->toImage().mirrored(true, false);
-    updateImage(img);
+    addEffect(CEffect::FlipH);
 }
+
 void CPixmap::toVFlip() {
-    m_effects.push_back(CEffect::FlipV);
-    QImage img = this->toImage().mirrored(false, true);
-    updateImage(img);
+    addEffect(CEffect::FlipV);
 }
 
 void CPixmap::toBlackAndWhite() {
-    m_effects.push_back(CEffect::BlackAndWhite);
-    QImage img = this->toImage();
-    QImage dest(img.size(), img.format());
-    QColor pixel;
-    for(int x=0; x<img.width();x++) {
-        for (int y=0; y<img.height(); y++) {
-            pixel = img.pixel(x, y);
-            unsigned int average = (pixel.green()+ pixel.red() + pixel.blue()) / 3;
-            if(average > 127)
-                average = 255;
-            else
-                average = 0;
-            pixel.setGreen(average);
-            pixel.setBlue(average);
-            pixel.setRed(average);
-            dest.setPixel(x,y,pixel.rgb());
-        }
-    }
-    updateImage(dest);
+    addEffect(CEffect::BlackAndWhite);
 }
 
 void CPixmap::toGlow(int radius) {
-    m_effects.push_back(CEffect(CEffect::Glow, (qreal)radius));
-    GlowEffectWidget effect;
-    QImage dest = effect.glow(this->toImage(), radius);
-    updateImage(dest);
+    addEffect(CEffect(CEffect::Glow, (qreal)radius));
 }
 
 void CPixmap::toSepia() {
-    m_effects.push_back(CEffect::Sepia);
-    QImage img = this->toImage();
-    QImage dest(img.size(), img.format());
-    QColor pixel;
-    for(int x=0; x<img.width();x++) {
-        for (int y=0; y<img.height(); y++) {
-            pixel = img.pixel(x, y);
-            unsigned int average = (pixel.green()+ pixel.red() + pixel.blue()) / 3;
-            int red = average*1.176, green = average*0.837, blue = average*0.558;
-            pixel.setRed((red <= 255) ? red : 255 );
-            pixel.setGreen((green <= 255) ? green : 255 );
-            pixel.setBlue((blue <= 255) ? blue : 255 );
-            dest.setPixel(x,y,pixel.rgb());
-        }
+    addEffect(CEffect::Sepia);
+}
+
+void CPixmap::toBrightness(int offset) {
+    addEffect(CEffect(CEffect::Brightness, (qreal)offset));
+}
+
+void CPixmap::toContrast(int percent) {
+    addEffect(CEffect(CEffect::Contrast, (qreal)percent));
+}
+
+void CPixmap::toGamma(qreal gamma) {
+    addEffect(CEffect(CEffect::Gamma, gamma));
+}
+
+void CPixmap::applyEffects() {
+    setEffectsResult(m_effects, computeEffects(m_effects));
+}
+
+QImage CPixmap::computeEffects(const QList<CEffect> & effects) {
+    QList<CEffect> tail;
+    QImage image = effectsBase(effects, &tail);
+    if (!image.isNull() && !tail.isEmpty())
+        image = EffectChain(tail, displayScale()).apply(image);
+    return image;
+}
+
+QImage CPixmap::effectsBase(const QList<CEffect> & effects, QList<CEffect> * tail, bool decode) {
+    // Start from the longest memoized prefix of the effects list...
+    ImageCache * cache = ImageCache::instance();
+    const int length = effects.size();
+    int prefix = length;
+    QImage image;
+    for (; prefix > 0 && image.isNull(); --prefix)
+        image = cache->find(memoKey(effects, prefix));
+    if (!image.isNull())
+        ++prefix;
+    else if (decode || !m_original.isNull())
+        image = originalImage();
+    else
+        image = cache->find(memoKey(effects, 0));
+
+    // ...the tail is what is left to run on it
+    if (tail)
+        *tail = effects.mid(prefix);
+    return image;
+}
+
+void CPixmap::setEffectsResult(const QList<CEffect> & effects, const QImage & result) {
+    if (result.isNull())
+        return;
+    m_effects = effects;
+    if (!m_effects.isEmpty())
+        ImageCache::instance()->insert(memoKey(m_effects, m_effects.size()), result);
+    m_size = result.size();
+    m_hasAlpha = result.hasAlphaChannel();
+
+    // the scaled copies are of the previous result
+    ImageCache::instance()->removeGroup(m_scaledGroup);
+    m_lastScaledSize = QSize();
+}
+
+QString CPixmap::filePath() const {
+    return m_filePath;
+}
+
+QImage CPixmap::loadForDisplay(const QString &fileName, QSize * fullSize) {
+    QImageReader reader(fileName);
+    const QSize size = reader.size();
+    if (fullSize)
+        *fullSize = size;
+    if (size.width() > DISPLAY_MAX_SIDE || size.height() > DISPLAY_MAX_SIDE) {
+        QSize scaledSize = size;
+        scaledSize.scale(DISPLAY_MAX_SIDE, DISPLAY_MAX_SIDE, Qt::KeepAspectRatio);
+        reader.setScaledSize(scaledSize);
+    }
+    QImage image = reader.read();
+
+    // formats that can't tell the size before decoding
+    if (!size.isValid()) {
+        if (fullSize)
+            *fullSize = image.size();
+        if (image.width() > DISPLAY_MAX_SIDE || image.height() > DISPLAY_MAX_SIDE)
+            image = image.scaled(DISPLAY_MAX_SIDE, DISPLAY_MAX_SIDE, Qt::KeepAspectRatio, Qt::SmoothTransformation);
     }
-    updateImage(dest);
-}
-/*
-void CPixmap::toLuminosity(int value) {
-    m_effects.push_back(...);
-    QImage img = this->toImage();
-    QImage dest(img.size(), img.format());
-    QColor pixel;
-    for(int x=0; x<img.width();x++) {
-        for (int y=0; y<img.height(); y++) {
-            pixel = img.pixel(x, y);
-            int green = pixel.green() + value;
-            int red = pixel.red() + value;
-            int blue = pixel.blue() + value;
-            if(green > 255) green = 255;
-            else if(green < 0) green = 0;
-            if(red > 255) red = 255;
-            else if(red < 0) red = 0;
-            if(blue > 255) blue = 255;
-            else if(blue <0) blue = 0;
-
-            pixel.setGreen(green);
-            pixel.setBlue(blue);
-            pixel.setRed(red);
-            dest.setPixel(x,y,pixel.rgb());
-        }
+    return image;
+}
+
+QSize CPixmap::fullSize() const {
+    return m_fullSize;
+}
+
+bool CPixmap::isReduced() const {
+    return !m_filePath.isEmpty() && m_fullSize.isValid() && m_fullSize.width() > width();
+}
+
+qreal CPixmap::displayScale() const {
+    if (!isReduced())
+        return 1.0;
+    return (qreal)width() / (qreal)m_fullSize.width();
+}
+
+QImage CPixmap::fullResolutionImage() {
+    if (!isReduced())
+        return toImage();
+
+    // keep it around while rendering: items can be painted more than once
+    ImageCache * cache = ImageCache::instance();
+    const QString key = fullKey();
+    QImage image = cache->find(key);
+    if (image.isNull()) {
+        image = EffectChain(m_effects).apply(QImage(m_filePath));
+        cache->insert(key, image);
     }
-    updateImage(dest);
-}
-*/
-void CPixmap::updateImage(QImage &newImage) {
-    QString copyFilePath = m_filePath;
-    QList<CEffect> copyEffects = m_effects;
-    *this = fromImage(newImage);
-    m_filePath = copyFilePath;
-    m_effects = copyEffects;
+    return image;
+}
+
+// the original decoded by the replay of a snapshot, in any thread
+class FullResolutionSource : public RenderSnapshot::Source {
+public:
+    FullResolutionSource(const QString &filePath, const QList<CEffect> &effects)
+        : m_filePath(filePath), m_effects(effects) {}
+    QImage load() const {
+        return EffectChain(m_effects).apply(QImage(m_filePath));
+    }
+private:
+    QString m_filePath;
+    QList<CEffect> m_effects;
+};
+
+RenderSnapshot::Source * CPixmap::fullResolutionSource() const {
+    return new FullResolutionSource(m_filePath, m_effects);
+}
+
+void CPixmap::releaseFullResolutionImage() {
+    if (ImageCache * cache = ImageCache::instance())
+        cache->remove(fullKey());
+}
+
+void CPixmap::releaseFullResolution() {
+    if (ImageCache * cache = ImageCache::instance())
+        cache->removeGroup(FULL_GROUP);
+}
+
+QPixmap CPixmap::smoothScaled(const QSize &size) {
+    if (isNull() || size.isEmpty())
+        return QPixmap();
+    QPixmap pixmap = cachedScaled(size);
+    if (pixmap.isNull()) {
+        pixmap = QPixmap::fromImage(scaleImage(scaleSource(size), size));
+        ImageCache::instance()->insert(scaledKey(sizeName(size)), pixmap);
+    }
+    m_lastScaledSize = size;
+    return pixmap;
+}
+
+QImage CPixmap::scaleSource(const QSize &size) {
+    // the smallest level still larger than the target
+    int level = 0;
+    while ((width() >> (level + 1)) >= size.width() && (height() >> (level + 1)) >= size.height())
+        ++level;
+    return pyramidLevel(level);
+}
+
+QImage CPixmap::scaleImage(const QImage &source, const QSize &size) {
+    return source.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+}
+
+void CPixmap::setScaled(const QSize &size, const QImage &scaled) {
+    if (scaled.size() != size)
+        return;
+    ImageCache::instance()->insert(scaledKey(sizeName(size)), QPixmap::fromImage(scaled));
+    m_lastScaledSize = size;
+}
+
+QPixmap CPixmap::cachedScaled(const QSize &size) const {
+    if (!size.isValid())
+        return QPixmap();
+    return ImageCache::instance()->findPixmap(scaledKey(sizeName(size)));
+}
+
+QPixmap CPixmap::lastScaled() const {
+    return cachedScaled(m_lastScaledSize);
+}
+
+QString CPixmap::sizeName(const QSize &size) {
+    return QString("%1x%2").arg(size.width()).arg(size.height());
+}
+
+QImage CPixmap::pyramidLevel(int level) {
+    if (level < 1)
+        return toImage();
+
+    // halve the level above, regenerating it too if evicted
+    ImageCache * cache = ImageCache::instance();
+    const QString key = scaledKey(QString("level%1").arg(level));
+    QImage image = cache->find(key);
+    if (image.isNull()) {
+        const QImage source = pyramidLevel(level - 1);
+        image = source.scaled(qMax(1, source.width() / 2), qMax(1, source.height() / 2), Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        cache->insert(key, image);
+    }
+    return image;
+}
+
+QImage CPixmap::originalImage() {
+    if (!m_original.isNull())
+        return m_original;
+    QImage image = ImageCache::instance()->find(memoKey(m_effects, 0));
+    if (image.isNull() && !m_filePath.isEmpty()) {
+        // evicted: decode it again
+        image = loadForDisplay(m_filePath);
+        ImageCache::instance()->insert(memoKey(m_effects, 0), image);
+    }
+    return image;
+}
+
+QString CPixmap::fullKey() const {
+    return QString(FULL_GROUP "/") + memoKey(m_effects, m_effects.size());
+}
+
+QString CPixmap::scaledKey(const QString & name) const {
+    return m_scaledGroup + '/' + name;
+}
+
+QString CPixmap::memoKey(const QList<CEffect> & effects, int prefixLength) const {
+    QString key = m_memoGroup + '/';
+    for (int i = 0; i < prefixLength; ++i)
+        key += QString("%1:%2;").arg((int)effects[i].effect).arg(effects[i].param);
+    return key;
 }
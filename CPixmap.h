@@ -22,31 +22,76 @@
 #ifndef ARNAUD_H_CPIXMAP
 #define ARNAUD_H_CPIXMAP
 
+#include <QImage>
+#include <QList>
 #include <QPixmap>
+#include <QSize>
+#include "RenderSnapshot.h"
+#include "effects/Effect.h"
 
-struct CEffect {
-    enum Effect {
-        ClearEffects = -1,  FlipH = 1,      FlipV = 2,
-        InvertColors = 3,   NVG = 4,        BlackAndWhite = 5,
-        Glow = 6,           Sepia = 7
-    } effect;
-    qreal param;
-
-    CEffect(Effect effect = ClearEffects, qreal param = 0.0) : effect(effect), param(param) {}
-};
-
-class CPixmap : public QPixmap {
+// The pixels live in the ImageCache, so they can be evicted at any time:
+// they are regenerated on demand from a memoized prefix of the effects, or
+// from the file.
+class CPixmap {
 public:
    CPixmap();
-   CPixmap(const QString &fileName);
+   CPixmap(const QString &fileName, const QImage &decoded = QImage(), const QSize &fullSize = QSize(), bool preview = false);  // 'decoded' saves reading the file, a 'preview' is not shared
+   CPixmap(const QPixmap &pixmap);  // for images without a file (e.g. video stills)
+   ~CPixmap();
 
-   // effects
+   // the pixels with the effects
+   bool isNull() const;
+   int width() const;
+   int height() const;
+   QSize size() const;
+   bool hasAlpha() const;
+   QImage toImage();
+
+   // effects (applied over the pristine image in a single fused run)
    void addEffect(const CEffect & effect);
+   void setEffects(const QList<CEffect> & effects);
    void clearEffects();
 
    // the ordered sequence of effects
    QList<CEffect> effects() const;
 
+   // effects computed elsewhere: run 'tail' (in any thread) over the returned
+   // pixels to get 'effects', then hand the result back with setEffectsResult.
+   // if 'decode' is false, a null image is returned (and 'tail' is 'effects')
+   // when the original has been evicted and has to be read from filePath()
+   QImage effectsBase(const QList<CEffect> & effects, QList<CEffect> * tail, bool decode = true);
+   void setEffectsResult(const QList<CEffect> & effects, const QImage & result);
+   QString filePath() const;
+
+   // the pixels are decoded at a display size: at most 1600
+   // pixels per side (JPEG can scale while decoding). Reentrant.
+   static QImage loadForDisplay(const QString &fileName, QSize * fullSize = 0);
+
+   // the file pixels with the effects, at the original resolution: decoded on
+   // demand (e.g. for the exports) and kept until released: by the owner
+   // alone, or all at once at the end of a render. snapshots decode it while
+   // replaying, through a source (for the owner to draw)
+   QSize fullSize() const;
+   bool isReduced() const;
+   qreal displayScale() const;  // display pixels per original pixel
+   QImage fullResolutionImage();
+   RenderSnapshot::Source * fullResolutionSource() const;
+   void releaseFullResolutionImage();
+   static void releaseFullResolution();
+
+   // smooth rescale, from the nearest larger level of a pyramid of halved
+   // copies built on demand: costs about the output size, not the source one.
+   // the result is cached too; lastScaled() returns it only if still there
+   QPixmap smoothScaled(const QSize &size);
+   QPixmap cachedScaled(const QSize &size) const;
+   QPixmap lastScaled() const;
+
+   // the same in steps, to rescale in another thread: the pyramid level to
+   // start from, the (reentrant) rescale, and the result back in the cache
+   QImage scaleSource(const QSize &size);
+   static QImage scaleImage(const QImage &source, const QSize &size);
+   void setScaled(const QSize &size, const QImage &scaled);
+
    // manual operations
    void toNVG();
    void toInvertedColors();
@@ -55,13 +100,35 @@ public:
    void toBlackAndWhite();
    void toGlow(int radius);
    void toSepia();  // Old photo style
-   //void toLuminosity(int value);
+   void toBrightness(int offset);
+   void toContrast(int percent);
+   void toGamma(qreal gamma);
 
 private:
-    CPixmap(const QPixmap &pixmap);
-    void updateImage(QImage &newImage);
+    void applyEffects();
+    QImage computeEffects(const QList<CEffect> & effects);
+    QImage originalImage();
+    QString memoKey(const QList<CEffect> & effects, int prefixLength) const;
+    QString fullKey() const;
+    QString scaledKey(const QString & name) const;
+    static QString sizeName(const QSize &size);
+    QImage pyramidLevel(int level);
 
     QString m_filePath;
+    // Size of the original in the file (the pixmap may be smaller)
+    QSize m_fullSize;
+    // ImageCache group holding the original (empty prefix) and the memoized
+    // results of the effect list prefixes, shared by the CPixmaps of the same
+    // file (but not by previews); the pyramid levels and the scaled copies of the current result
+    // are in a group of this CPixmap
+    QString m_memoGroup;
+    QString m_scaledGroup;
+    // Size and alpha of the result (even if evicted)
+    QSize m_size;
+    bool m_hasAlpha;
+    QSize m_lastScaledSize;
+    // The decoded image, kept only if it can't be reloaded from a file
+    QImage m_original;
     // Ordered list of currently applied effects
     QList<CEffect> m_effects;
 };
@@ -13,10 +13,17 @@
  ***************************************************************************/
 
 #include "Desk.h"
+#include "CPixmap.h"
+#include "EffectBatch.h"
+#include "FolderImporter.h"
+#include "ItemCachePolicy.h"
+#include "PictureLoader.h"
+#include "RenderSnapshot.h"
 #include "frames/FrameFactory.h"
 #include "items/ColorPickerItem.h"
 #include "items/HelpItem.h"
 #include "items/HighlightItem.h"
+#include "items/MirrorItem.h"
 #include "items/PictureContent.h"
 #include "items/PictureProperties.h"
 #include "items/TextContent.h"
@@ -26,6 +33,7 @@
 #include "RenderOpts.h"
 #include <QAbstractTextDocumentLayout>
 #include <QFile>
+#include <QFileInfo>
 #include <QGraphicsSceneDragDropEvent>
 #include <QGraphicsView>
 #include <QImageReader>
@@ -34,12 +42,16 @@
 #include <QMimeData>
 #include <QPrinter>
 #include <QPrintDialog>
+#include <QStyle>
+#include <QStyleOptionGraphicsItem>
 #include <QTextDocument>
 #include <QTimer>
 #include <QUrl>
+#include <QVector>
 
 #define COLORPICKER_W 200
 #define COLORPICKER_H 150
+#define LAYER_TIMEOUT 600
 
 Desk::Desk(QObject * parent)
     : QGraphicsScene(parent)
@@ -51,7 +63,19 @@ Desk::Desk(QObject * parent)
     , m_projectMode(ModeNormal)
     , m_webContentSelector(0)
     , m_forceFieldTimer(0)
+    , m_layerTimer(0)
+    , m_importIndex(0)
 {
+    // decode the pictures in the background
+    m_pictureLoader = new PictureLoader(this);
+
+    // the content layer lives until the decorations settle
+    m_layerTimer = new QTimer(this);
+    m_layerTimer->setSingleShot(true);
+    m_layerTimer->setInterval(LAYER_TIMEOUT);
+    connect(m_layerTimer, SIGNAL(timeout()), this, SLOT(slotLeaveLayerMode()));
+    connect(m_pictureLoader, SIGNAL(loadFailed(PictureContent *)), this, SLOT(slotPictureLoadFailed(PictureContent *)));
+
     // create colorpickers
     m_titleColorPicker = new ColorPickerItem(COLORPICKER_W, COLORPICKER_H, 0);
     m_titleColorPicker->setColor(Qt::red);
@@ -110,19 +134,7 @@ static QPoint nearCenter(const QRectF & rect)
 
 void Desk::addPictures(const QStringList & fileNames)
 {
-    QPoint pos = nearCenter(sceneRect());
-    foreach (const QString & localFile, fileNames) {
-        if (!QFile::exists(localFile))
-            continue;
-
-        // create picture and load the file
-        PictureContent * p = createPicture(pos);
-        if (!p->loadPhoto(localFile, true, true)) {
-            m_content.removeAll(p);
-            delete p;
-        } else
-            pos += QPoint(30, 30);
-    }
+    loadPictures(fileNames, nearCenter(sceneRect()));
 }
 
 void Desk::addTextContent()
@@ -178,6 +190,7 @@ void Desk::resize(const QSize & size)
         properties->keepInBoundaries(m_rect.toRect());
 
     // change my rect
+    slotLeaveLayerMode();
     setSceneRect(m_rect);
 }
 
@@ -219,7 +232,7 @@ void Desk::setBackGradientEnabled(bool enabled)
     m_grad2ColorPicker->setVisible(enabled);
     if (enabled)
         blinkBackGradients();
-    update();
+    updateDecoration();
 }
 
 bool Desk::backGradientEnabled() const
@@ -233,7 +246,7 @@ void Desk::setTopBarEnabled(bool enabled)
         return;
     m_topBarEnabled = enabled;
     m_foreColorPicker->setVisible(m_topBarEnabled || m_bottomBarEnabled);
-    update();
+    updateDecoration(QRectF(0, 0, m_size.width(), 50));
 }
 
 bool Desk::topBarEnabled() const
@@ -247,7 +260,7 @@ void Desk::setBottomBarEnabled(bool enabled)
         return;
     m_bottomBarEnabled = enabled;
     m_foreColorPicker->setVisible(m_topBarEnabled || m_bottomBarEnabled);
-    update();
+    updateDecoration(QRectF(0, m_size.height() - 50, m_size.width(), 50));
 }
 
 bool Desk::bottomBarEnabled() const
@@ -259,7 +272,7 @@ void Desk::setTitleText(const QString & text)
 {
     m_titleText = text;
     m_titleColorPicker->setVisible(!text.isEmpty());
-    update(0, 0, m_size.width(), 50);
+    updateDecoration(QRectF(0, 0, m_size.width(), 50));
 }
 
 QString Desk::titleText() const
@@ -338,9 +351,12 @@ void Desk::renderVisible(QPainter * painter, const QRectF & target, const QRectF
     foreach(AbstractProperties *prop, m_properties)
         prop->hide();
 
+    // the device caches need a viewport: off the screen the contents paint
+    // themselves, and the screen caches stay valid
     RenderOpts::HQRendering = true;
     QGraphicsScene::render(painter, target, source, aspectRatioMode);
     RenderOpts::HQRendering = false;
+    CPixmap::releaseFullResolution();
 
     foreach(AbstractProperties *prop, m_properties)
         prop->show();
@@ -350,12 +366,35 @@ void Desk::renderVisible(QPainter * painter, const QRectF & target, const QRectF
 
 QImage Desk::renderedImage(const QSize & iSize, Qt::AspectRatioMode aspectRatioMode)
 {
-    QImage result(iSize, QImage::Format_ARGB32);
-    result.fill(0);
+    // record the scene once, then rasterize the recording on all the cores
+    RenderSnapshot snapshot(iSize);
+    renderSnapshot(&snapshot, aspectRatioMode);
+    if (snapshot.isExact())
+        return snapshot.toImage();
+
+    // text the replay would not lay out as the scene: paint it directly
+    QImage image(iSize, QImage::Format_ARGB32);
+    image.fill(0);
+    renderDevice(&image, iSize, aspectRatioMode, false);
+    return image;
+}
 
-    QPainter painter(&result);
+void Desk::renderSnapshot(RenderSnapshot * snapshot, Qt::AspectRatioMode aspectRatioMode, bool rotated)
+{
+    renderDevice(snapshot, snapshot->size(), aspectRatioMode, rotated);
+}
+
+void Desk::renderDevice(QPaintDevice * device, QSize iSize, Qt::AspectRatioMode aspectRatioMode, bool rotated)
+{
+    QPainter painter(device);
     painter.setRenderHints(QPainter::Antialiasing | QPainter::TextAntialiasing | QPainter::SmoothPixmapTransform);
 
+    // turn clockwise, as QImage::transformed() by a 90 degrees rotation
+    if (rotated) {
+        painter.translate(iSize.width(), 0);
+        painter.rotate(90);
+        iSize.transpose();
+    }
     QSize targetSize = sceneRect().size().toSize();
     targetSize.scale(iSize, aspectRatioMode);
     int offsetX = (iSize.width() - targetSize.width()) / 2;
@@ -364,8 +403,6 @@ QImage Desk::renderedImage(const QSize & iSize, Qt::AspectRatioMode aspectRatioM
     QRect targetRect = QRect(offsetX, offsetY, targetSize.width(), targetSize.height());
     renderVisible(&painter, targetRect, sceneRect(), Qt::IgnoreAspectRatio);
     painter.end();
-
-    return result;
 }
 
 bool Desk::printAsImage(int printerDpi, const QSize & pixelSize, bool landscape, Qt::AspectRatioMode aspectRatioMode)
@@ -447,20 +484,10 @@ void Desk::dropEvent(QGraphicsSceneDragDropEvent * event)
 
     // or handle as a Desk drop event
     event->accept();
-    QPoint pos = event->scenePos().toPoint();
-    foreach (const QUrl & url, event->mimeData()->urls()) {
-        QString localFile = url.toLocalFile();
-        if (!QFile::exists(localFile))
-            continue;
-
-        // create PictureContent from file
-        PictureContent * p = createPicture(pos);
-        if (!p->loadPhoto(localFile, true, true)) {
-            m_content.removeAll(p);
-            delete p;
-        } else
-            pos += QPoint(30, 30);
-    }
+    QStringList localFiles;
+    foreach (const QUrl & url, event->mimeData()->urls())
+        localFiles.append(url.toLocalFile());
+    loadPictures(localFiles, event->scenePos().toPoint());
 }
 
 void Desk::keyPressEvent(QKeyEvent * keyEvent)
@@ -497,7 +524,135 @@ void Desk::contextMenuEvent( QGraphicsSceneContextMenuEvent * event )
 
 
 /// Scene Background & Foreground
+// the items painted in the content layer: contents, their mirrors and controls
+static bool isContentItem(QGraphicsItem * item)
+{
+    QGraphicsItem * topLevel = item->topLevelItem();
+    return dynamic_cast<AbstractContent *>(topLevel) || dynamic_cast<MirrorItem *>(topLevel);
+}
+
+void Desk::updateDecoration(const QRectF & rect)
+{
+    // decorations change often (dragging the color pickers): don't repaint the content
+    enterLayerMode();
+    update(rect);
+}
+
+void Desk::enterLayerMode()
+{
+    m_layerTimer->start();
+    if (!m_contentLayer.isNull() || m_forceFieldTimer || m_pictureLoader->pendingCount() || m_size.isEmpty())
+        return;
+
+    // the content is changing by itself (videos, effects, decodes): the layer would be stale
+    if (m_contentChangeTime.isValid() && m_contentChangeTime.elapsed() < LAYER_TIMEOUT)
+        return;
+
+    // the visible content, in stacking order
+    const QList<QGraphicsItem *> visibleItems = items(sceneRect());
+    QVector<QGraphicsItem *> layerItems;
+    for (int i = visibleItems.size() - 1; i >= 0; --i)
+        if (isContentItem(visibleItems[i]))
+            layerItems.append(visibleItems[i]);
+    QVector<QStyleOptionGraphicsItem> options(layerItems.size());
+    for (int i = 0; i < layerItems.size(); ++i) {
+        options[i].rect = layerItems[i]->boundingRect().toRect();
+        options[i].exposedRect = layerItems[i]->boundingRect();
+        if (layerItems[i]->isSelected())
+            options[i].state |= QStyle::State_Selected;
+    }
+
+    // paint it once, as the view does
+    m_contentLayer = QPixmap(m_size);
+    m_contentLayer.fill(Qt::transparent);
+    QPainter painter(&m_contentLayer);
+    painter.setRenderHints(QPainter::Antialiasing | QPainter::TextAntialiasing);
+    painter.translate(-sceneRect().topLeft());
+    QGraphicsScene::drawItems(&painter, layerItems.size(), layerItems.data(), options.data(), 0);
+    painter.end();
+
+    // views paint through drawItems() only when asked to
+#if QT_VERSION >= 0x040600
+    foreach (QGraphicsView * view, views())
+        view->setOptimizationFlag(QGraphicsView::IndirectPainting, true);
+#endif
+}
+
 void Desk::drawBackground(QPainter * painter, const QRectF & rect)
+{
+    // describe the layer to a snapshot being recorded
+    RenderSnapshot * snapshot = dynamic_cast<RenderSnapshot *>(painter->device());
+    if (snapshot) {
+        RenderSnapshot::Item item(RenderSnapshot::Item::Background);
+        item.transform = painter->worldTransform();
+        snapshot->beginItem(item);
+    }
+    paintBackground(painter, rect);
+    if (snapshot)
+        snapshot->endItem();
+}
+
+void Desk::drawForeground(QPainter * painter, const QRectF & rect)
+{
+    RenderSnapshot * snapshot = dynamic_cast<RenderSnapshot *>(painter->device());
+    if (snapshot) {
+        RenderSnapshot::Item item(RenderSnapshot::Item::Foreground);
+        item.transform = painter->worldTransform();
+        snapshot->beginItem(item);
+    }
+    paintForeground(painter, rect);
+    if (snapshot)
+        snapshot->endItem();
+}
+
+void Desk::drawItems(QPainter * painter, int numItems, QGraphicsItem * items[], const QStyleOptionGraphicsItem options[], QWidget * widget)
+{
+    RenderSnapshot * snapshot = dynamic_cast<RenderSnapshot *>(painter->device());
+    if (!snapshot) {
+        // while editing the decorations, blend the cached content
+        if (!m_contentLayer.isNull() && painter->worldTransform().type() <= QTransform::TxTranslate) {
+            // the other items keep their place around the layer
+            QVector<QGraphicsItem *> below, above;
+            QVector<QStyleOptionGraphicsItem> belowOptions, aboveOptions;
+            bool layerPassed = false;
+            for (int i = 0; i < numItems; ++i) {
+                if (isContentItem(items[i])) {
+                    layerPassed = true;
+                    continue;
+                }
+                (layerPassed ? above : below).append(items[i]);
+                (layerPassed ? aboveOptions : belowOptions).append(options[i]);
+            }
+            QGraphicsScene::drawItems(painter, below.size(), below.data(), belowOptions.data(), widget);
+            painter->drawPixmap(sceneRect().topLeft(), m_contentLayer);
+            QGraphicsScene::drawItems(painter, above.size(), above.data(), aboveOptions.data(), widget);
+            return;
+        }
+        QGraphicsScene::drawItems(painter, numItems, items, options, widget);
+        return;
+    }
+
+    // record the items one by one (in stacking order), each with its description
+    const QTransform sceneTransform = painter->worldTransform();
+    for (int i = 0; i < numItems; ++i) {
+        QGraphicsItem * graphicsItem = items[i];
+        RenderSnapshot::Item item;
+        item.zValue = graphicsItem->zValue();
+        item.transform = graphicsItem->sceneTransform() * sceneTransform;
+        if (AbstractContent * content = dynamic_cast<AbstractContent *>(graphicsItem)) {
+            item.kind = RenderSnapshot::Item::Content;
+            item.className = content->metaObject()->className();
+            item.frameClass = content->frameClass();
+            item.mirrored = content->mirrorEnabled();
+        } else if (dynamic_cast<MirrorItem *>(graphicsItem))
+            item.kind = RenderSnapshot::Item::Mirror;
+        snapshot->beginItem(item);
+        QGraphicsScene::drawItems(painter, 1, &items[i], &options[i], widget);
+        snapshot->endItem();
+    }
+}
+
+void Desk::paintBackground(QPainter * painter, const QRectF & rect)
 {
     // draw content if set
     if (m_backContent) {
@@ -535,7 +690,7 @@ static void drawVerticalShadow(QPainter * painter, int width, int height)
     painter->fillRect( 0, 0, width, height, lg );
 }
 
-void Desk::drawForeground(QPainter * painter, const QRectF & rect)
+void Desk::paintForeground(QPainter * painter, const QRectF & rect)
 {
     // draw header/footer
     const int top = (int)rect.top();
@@ -587,14 +742,45 @@ void Desk::initContent(AbstractContent * content, const QPoint & pos)
     connect(content, SIGNAL(backgroundMe()), this, SLOT(slotBackgroundContent()));
     connect(content, SIGNAL(changeStack(int)), this, SLOT(slotStackContent(int)));
     connect(content, SIGNAL(deleteItem()), this, SLOT(slotDeleteContent()));
+    connect(content, SIGNAL(contentChanged()), this, SLOT(slotContentChanged()));
 
     if (!pos.isNull())
         content->setPos(pos);
     content->setZValue(m_content.isEmpty() ? 1 : (m_content.last()->zValue() + 1));
-    //content->setCacheMode(QGraphicsItem::DeviceCoordinateCache);
     content->show();
+    ItemCachePolicy::instance()->addContent(content);
 
     m_content.append(content);
+    slotLeaveLayerMode();
+}
+
+void Desk::loadPictures(const QStringList & paths, const QPoint & pos)
+{
+    QPoint filePos = pos;
+    QStringList folders;
+    foreach (const QString & localFile, paths) {
+        if (QFileInfo(localFile).isDir()) {
+            folders.append(localFile);
+            continue;
+        }
+        if (!QFile::exists(localFile))
+            continue;
+
+        // create picture and load the file in background
+        PictureContent * p = createPicture(filePos);
+        p->showPlaceholder(localFile);
+        m_pictureLoader->load(p, localFile);
+        filePos += QPoint(30, 30);
+    }
+
+    // import the folders through their own pipeline
+    if (!folders.isEmpty()) {
+        m_importOrigin = filePos;
+        m_importIndex = 0;
+        FolderImporter * importer = new FolderImporter(folders, this);
+        connect(importer, SIGNAL(imported(const QString &, const QImage &, const QSize &)),
+                this, SLOT(slotPictureImported(const QString &, const QImage &, const QSize &)));
+    }
 }
 
 PictureContent * Desk::createPicture(const QPoint & pos)
@@ -827,17 +1013,39 @@ void Desk::slotApplyLook(quint32 frameClass, bool mirrored, bool all)
     }
 }
 
+void Desk::slotPictureLoadFailed(PictureContent * picture)
+{
+    // as an unreadable file was never added
+    m_content.removeAll(picture);
+    delete picture;
+}
+
+void Desk::slotPictureImported(const QString & fileName, const QImage & image, const QSize & fullSize)
+{
+    // cascade in columns of 20
+    const int i = m_importIndex++;
+    const QPoint pos = m_importOrigin + QPoint(30 * (i % 20) + 40 * ((i / 20) % 25), 30 * (i % 20));
+    PictureContent * p = createPicture(pos);
+    if (!p->loadDecodedPhoto(fileName, image, fullSize, true, true))
+        slotPictureLoadFailed(p);
+}
+
 void Desk::slotApplyEffect(const CEffect & effect, bool all)
 {
     QList<AbstractContent *> selectedContent = content(selectedItems());
+    QList<PictureContent *> pictures;
     foreach (AbstractContent * content, m_content) {
         PictureContent * picture = dynamic_cast<PictureContent *>(content);
         if (!picture)
             continue;
 
         if (all || selectedContent.contains(content))
-            picture->addEffect(effect);
+            pictures.append(picture);
     }
+
+    // compute the effect in the thread pool, results are swapped in as they come
+    if (!pictures.isEmpty())
+        new EffectBatch(pictures, effect, this);
 }
 
 void Desk::slotFlipHorizontally()
@@ -864,20 +1072,39 @@ void Desk::slotFlipVertically()
 
 void Desk::slotTitleColorChanged()
 {
-    update(0, 0, m_size.width(), 50);
+    updateDecoration(QRectF(0, 0, m_size.width(), 50));
 }
 
 void Desk::slotForeColorChanged()
 {
-    update(0, 0, m_size.width(), 50);
-    update(0, m_size.height() - 50, m_size.width(), 50);
+    updateDecoration(QRectF(0, 0, m_size.width(), 50));
+    updateDecoration(QRectF(0, m_size.height() - 50, m_size.width(), 50));
 }
 
 void Desk::slotGradColorChanged()
 {
+    updateDecoration();
+}
+
+void Desk::slotLeaveLayerMode()
+{
+    if (m_contentLayer.isNull())
+        return;
+    m_contentLayer = QPixmap();
+#if QT_VERSION >= 0x040600
+    foreach (QGraphicsView * view, views())
+        view->setOptimizationFlag(QGraphicsView::IndirectPainting, false);
+#endif
     update();
 }
 
+void Desk::slotContentChanged()
+{
+    // a content changed under the layer: paint it live for a while
+    m_contentChangeTime.start();
+    slotLeaveLayerMode();
+}
+
 void Desk::slotCloseIntroduction()
 {
     m_helpItem->deleteLater();
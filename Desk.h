@@ -28,7 +28,9 @@ class ColorPickerItem;
 class HelpItem;
 class HighlightItem;
 class PictureContent;
+class PictureLoader;
 class QTimer;
+class RenderSnapshot;
 class TextContent;
 class VideoContent;
 class WebContentSelectorItem;
@@ -42,7 +44,7 @@ class Desk : public QGraphicsScene
         Desk(QObject * parent = 0);
         ~Desk();
 
-        // add content
+        // add content (folders are imported with all their subfolders)
         void addPictures(const QStringList & fileNames);
         void addTextContent();
         void addVideoContent(int input);
@@ -83,6 +85,7 @@ class Desk : public QGraphicsScene
         // render the Desk, but not the invisible items
         void renderVisible(QPainter * painter, const QRectF & target = QRectF(), const QRectF & source = QRectF(), Qt::AspectRatioMode aspectRatioMode = Qt::KeepAspectRatio);
         QImage renderedImage(const QSize & size, Qt::AspectRatioMode aspectRatioMode = Qt::KeepAspectRatio);
+        void renderSnapshot(RenderSnapshot * snapshot, Qt::AspectRatioMode aspectRatioMode = Qt::KeepAspectRatio, bool rotated = false);
         bool printAsImage(int printerDpi, const QSize & pixelSize, bool landscape, Qt::AspectRatioMode aspectRatioMode = Qt::KeepAspectRatio);
 
     protected:
@@ -94,14 +97,21 @@ class Desk : public QGraphicsScene
         void contextMenuEvent( QGraphicsSceneContextMenuEvent * event );
         void drawBackground( QPainter * painter, const QRectF & rect );
         void drawForeground( QPainter * painter, const QRectF & rect );
+        void drawItems(QPainter * painter, int numItems, QGraphicsItem * items[], const QStyleOptionGraphicsItem options[], QWidget * widget = 0);
 
     private:
         void initContent(AbstractContent * content, const QPoint & pos);
+        void loadPictures(const QStringList & paths, const QPoint & pos);
         PictureContent * createPicture(const QPoint & pos);
         TextContent * createText(const QPoint & pos);
         VideoContent * createVideo(int input, const QPoint & pos);
         void setDVDMarkers();
         void clearMarkers();
+        void paintBackground(QPainter * painter, const QRectF & rect);
+        void paintForeground(QPainter * painter, const QRectF & rect);
+        void renderDevice(QPaintDevice * device, QSize iSize, Qt::AspectRatioMode aspectRatioMode, bool rotated);
+        void updateDecoration(const QRectF & rect = QRectF());
+        void enterLayerMode();
         QList<AbstractContent *> m_content;
         QList<AbstractProperties *> m_properties;
         QList<HighlightItem *> m_highlightItems;
@@ -122,7 +132,13 @@ class Desk : public QGraphicsScene
         QList<QGraphicsItem *> m_markerItems;   // used by some modes to show information items, which won't be rendered
         WebContentSelectorItem * m_webContentSelector;
         QTimer * m_forceFieldTimer;
+        QPixmap m_contentLayer;         // the content, while editing the decorations
+        QTimer * m_layerTimer;
+        PictureLoader * m_pictureLoader;
+        QPoint m_importOrigin;
+        int m_importIndex;
         QTime m_forceFieldTime;
+        QTime m_contentChangeTime;
 
     private Q_SLOTS:
         void slotConfigureContent(const QPoint & scenePoint);
@@ -131,6 +147,8 @@ class Desk : public QGraphicsScene
         void slotDeleteContent();
         void slotDeleteProperties();
         void slotApplyLook(quint32 frameClass, bool mirrored, bool allContent);
+        void slotPictureLoadFailed(PictureContent * picture);
+        void slotPictureImported(const QString & fileName, const QImage & image, const QSize & fullSize);
         void slotApplyEffect(const CEffect & effect, bool allPictures);
         void slotFlipHorizontally();
         void slotFlipVertically();
@@ -141,6 +159,8 @@ class Desk : public QGraphicsScene
 
         void slotCloseIntroduction();
         void slotApplyForce();
+        void slotLeaveLayerMode();
+        void slotContentChanged();
 };
 
 #endif
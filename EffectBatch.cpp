@@ -0,0 +1,122 @@
+/***************************************************************************
+ *                                                                         *
+ *   This file is part of the FotoWall project,                            *
+ *       http://code.google.com/p/fotowall                                 *
+ *                                                                         *
+ *   Copyright (C) 2009 by Enrico Ros <enrico.ros@gmail.com>               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "EffectBatch.h"
+#include "CPixmap.h"
+#include "effects/EffectChain.h"
+#include "items/PictureContent.h"
+#include <QProgressDialog>
+#include <QThread>
+#include <QtConcurrentRun>
+
+EffectBatch::EffectBatch(const QList<PictureContent *> & pictures, const CEffect & effect, QObject * parent)
+    : QObject(parent)
+    , m_effect(effect)
+    , m_maxJobs(qMax(1, QThread::idealThreadCount()))
+    , m_done(0)
+    , m_progress(0)
+{
+    foreach (PictureContent * picture, pictures)
+        m_queue.append(picture);
+
+    // show the progress only if it takes a while
+    m_progress = new QProgressDialog(tr("Applying the effect..."), tr("Cancel"), 0, m_queue.size());
+    m_progress->setWindowTitle(tr("Effects"));
+    m_progress->setMinimumDuration(500);
+    connect(m_progress, SIGNAL(canceled()), this, SLOT(cancel()));
+    startJobs();
+    if (m_running.isEmpty())
+        deleteLater();
+}
+
+EffectBatch::~EffectBatch()
+{
+    // the jobs still running don't reference us, their results are discarded
+    qDeleteAll(m_running.keys());
+    delete m_progress;
+}
+
+void EffectBatch::cancel()
+{
+    // pictures already swapped in keep the effect, the rest won't start
+    m_queue.clear();
+    if (m_running.isEmpty())
+        deleteLater();
+}
+
+void EffectBatch::startJobs()
+{
+    while (m_running.size() < m_maxJobs && !m_queue.isEmpty()) {
+        PictureContent * picture = m_queue.takeFirst();
+        if (!picture) {
+            ++m_done;
+            continue;
+        }
+
+        // snapshot the work in the GUI thread: workers never touch the pictures
+        Job job;
+        job.picture = picture;
+        job.fromEffects = picture->effects();
+        job.toEffects = job.fromEffects;
+        if (m_effect.effect == CEffect::ClearEffects)
+            job.toEffects.clear();
+        else
+            job.toEffects.append(m_effect);
+
+        Work work;
+        work.base = picture->effectsBase(job.toEffects, &work.tail);
+        work.scale = picture->effectsScale();
+        if (work.base.isNull() && !picture->isPlaceholder())
+            work.filePath = picture->filePath();
+
+        QFutureWatcher<QImage> * watcher = new QFutureWatcher<QImage>();
+        connect(watcher, SIGNAL(finished()), this, SLOT(slotJobFinished()));
+        m_running.insert(watcher, job);
+        watcher->setFuture(QtConcurrent::run(&EffectBatch::runWork, work));
+    }
+    if (m_progress)
+        m_progress->setValue(m_done);
+}
+
+QImage EffectBatch::runWork(const Work & work)
+{
+    QImage image = work.base;
+    if (image.isNull() && !work.filePath.isEmpty())
+        image = CPixmap::loadForDisplay(work.filePath);
+    return EffectChain(work.tail, work.scale).apply(image);
+}
+
+void EffectBatch::slotJobFinished()
+{
+    QFutureWatcher<QImage> * watcher = static_cast<QFutureWatcher<QImage> *>(sender());
+    if (!m_running.contains(watcher))
+        return;
+    const Job job = m_running.take(watcher);
+    const QImage result = watcher->result();
+    watcher->deleteLater();
+    ++m_done;
+
+    // the picture may have been deleted meanwhile, or changed: then append
+    // the effect to what it has now
+    if (job.picture) {
+        if (job.picture->effects() != job.fromEffects)
+            job.picture->addEffect(m_effect);
+        else
+            job.picture->setEffectsResult(job.toEffects, result);
+    }
+
+    startJobs();
+    if (m_running.isEmpty())
+        deleteLater();
+}
@@ -0,0 +1,74 @@
+/***************************************************************************
+ *                                                                         *
+ *   This file is part of the FotoWall project,                            *
+ *       http://code.google.com/p/fotowall                                 *
+ *                                                                         *
+ *   Copyright (C) 2009 by Enrico Ros <enrico.ros@gmail.com>               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __EffectBatch_h__
+#define __EffectBatch_h__
+
+#include <QObject>
+#include <QFutureWatcher>
+#include <QImage>
+#include <QList>
+#include <QMap>
+#include <QPointer>
+#include "effects/Effect.h"
+class PictureContent;
+class QProgressDialog;
+
+/**
+    \brief Applies an effect to many pictures on the global thread pool
+
+    The pixels are computed by the pool, a job per picture and no more jobs
+    than threads; each picture then gets its result swapped in at once, by
+    the GUI thread, as soon as it's ready, and the job is released: only the
+    results being computed are held, not the whole batch. Shows the progress
+    and can be canceled: the pictures already done keep the effect.
+    Deletes itself when done.
+*/
+class EffectBatch : public QObject
+{
+    Q_OBJECT
+    public:
+        EffectBatch(const QList<PictureContent *> & pictures, const CEffect & effect, QObject * parent = 0);
+        ~EffectBatch();
+
+    public Q_SLOTS:
+        void cancel();
+
+    private:
+        struct Work {
+            QImage base;            // the pixels to start from...
+            QString filePath;       // ...or the file to decode if evicted
+            QList<CEffect> tail;    // what to run on them
+            qreal scale;            // of the pixels over the original
+        };
+        struct Job {
+            QPointer<PictureContent> picture;
+            QList<CEffect> fromEffects;
+            QList<CEffect> toEffects;
+        };
+        void startJobs();
+        static QImage runWork(const Work & work);
+
+        CEffect m_effect;
+        QList<QPointer<PictureContent> > m_queue;
+        QMap<QFutureWatcher<QImage> *, Job> m_running;
+        int m_maxJobs;
+        int m_done;
+        QProgressDialog * m_progress;
+
+    private Q_SLOTS:
+        void slotJobFinished();
+};
+
+#endif
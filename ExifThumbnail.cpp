@@ -0,0 +1,146 @@
+/***************************************************************************
+ *                                                                         *
+ *   This file is part of the FotoWall project,                            *
+ *       http://code.google.com/p/fotowall                                 *
+ *                                                                         *
+ *   Copyright (C) 2009 by Enrico Ros <enrico.ros@gmail.com>               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "ExifThumbnail.h"
+#include <QFile>
+#include <QImageReader>
+#include <string.h>
+
+// the EXIF segment (APP1) is at most 64K and comes right after the SOI
+#define HEAD_BYTES (128 * 1024)
+
+// EXIF tags
+#define TAG_EXIF_IFD        0x8769
+#define TAG_THUMB_OFFSET    0x0201
+#define TAG_THUMB_LENGTH    0x0202
+#define TAG_PIXEL_X         0xA002
+#define TAG_PIXEL_Y         0xA003
+
+// TIFF structure (the EXIF payload), with bound-checked reads
+struct Tiff {
+    const uchar * data;
+    int size;
+    bool motorola;
+
+    quint32 u16(int pos) const {
+        if (pos < 0 || pos + 2 > size)
+            return 0;
+        return motorola ? (data[pos] << 8) | data[pos + 1] : data[pos] | (data[pos + 1] << 8);
+    }
+    quint32 u32(int pos) const {
+        if (pos < 0 || pos + 4 > size)
+            return 0;
+        return motorola ? (u16(pos) << 16) | u16(pos + 2) : u16(pos) | (u16(pos + 2) << 16);
+    }
+
+    // the numeric value of a SHORT or LONG entry
+    quint32 value(int entry) const {
+        return u16(entry + 2) == 3 ? u16(entry + 8) : u32(entry + 8);
+    }
+
+    // the entries of the IFD at 'offset', returns the offset of the next IFD
+    template <typename Visitor>
+    quint32 visitIfd(quint32 offset, Visitor & visitor) const {
+        if (offset < 8 || offset > (quint32)size - 2)
+            return 0;
+        const int count = u16(offset);
+        for (int i = 0; i < count; ++i) {
+            const int entry = offset + 2 + i * 12;
+            if (entry + 12 > size)
+                return 0;
+            visitor(u16(entry), value(entry));
+        }
+        return u32(offset + 2 + count * 12);
+    }
+};
+
+struct ExifTags {
+    quint32 exifIfd, thumbOffset, thumbLength, pixelX, pixelY;
+
+    ExifTags() : exifIfd(0), thumbOffset(0), thumbLength(0), pixelX(0), pixelY(0) {}
+    void operator()(quint32 tag, quint32 value) {
+        switch (tag) {
+            case TAG_EXIF_IFD:      exifIfd = value; break;
+            case TAG_THUMB_OFFSET:  thumbOffset = value; break;
+            case TAG_THUMB_LENGTH:  thumbLength = value; break;
+            case TAG_PIXEL_X:       pixelX = value; break;
+            case TAG_PIXEL_Y:       pixelY = value; break;
+        }
+    }
+};
+
+// the TIFF payload of the EXIF segment, if any
+static bool findExif(const QByteArray & head, Tiff * tiff)
+{
+    const uchar * data = (const uchar *)head.constData();
+    const int size = head.size();
+    if (size < 4 || data[0] != 0xFF || data[1] != 0xD8)
+        return false;
+    int pos = 2;
+    while (pos + 4 <= size && data[pos] == 0xFF) {
+        const uchar marker = data[pos + 1];
+        // image data or end: no EXIF
+        if (marker == 0xDA || marker == 0xD9)
+            return false;
+        const int length = (data[pos + 2] << 8) | data[pos + 3];
+        const int segment = pos + 4;
+        if (marker == 0xE1 && length >= 8 && segment + length - 2 <= size && !memcmp(data + segment, "Exif\0\0", 6)) {
+            tiff->data = data + segment + 6;
+            tiff->size = length - 8;
+            tiff->motorola = tiff->data[0] == 'M';
+            return tiff->size >= 8 && tiff->u16(2) == 42;
+        }
+        pos += 2 + length;
+    }
+    return false;
+}
+
+QImage ExifThumbnail::read(const QString & filePath, QSize * fullSize)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly))
+        return QImage();
+    const QByteArray head = file.read(HEAD_BYTES);
+    file.close();
+
+    // IFD0 points to the EXIF IFD (the dimensions), IFD1 is the thumbnail
+    Tiff tiff;
+    if (!findExif(head, &tiff))
+        return QImage();
+    ExifTags tags;
+    const quint32 ifd1 = tiff.visitIfd(tiff.u32(4), tags);
+    if (tags.exifIfd)
+        tiff.visitIfd(tags.exifIfd, tags);
+    if (ifd1)
+        tiff.visitIfd(ifd1, tags);
+    if (!tags.thumbOffset || !tags.thumbLength || tags.thumbOffset >= (quint32)tiff.size || tags.thumbLength > (quint32)tiff.size - tags.thumbOffset)
+        return QImage();
+    QImage thumbnail = QImage::fromData(tiff.data + tags.thumbOffset, tags.thumbLength);
+    if (thumbnail.isNull())
+        return thumbnail;
+
+    // crop the padding to the aspect ratio of the picture
+    QSize size(tags.pixelX, tags.pixelY);
+    if (!size.isValid() || size.isEmpty())
+        size = QImageReader(filePath).size();
+    if (size.isValid() && !size.isEmpty()) {
+        QSize cropped = size;
+        cropped.scale(thumbnail.size(), Qt::KeepAspectRatio);
+        if (cropped != thumbnail.size() && !cropped.isEmpty())
+            thumbnail = thumbnail.copy((thumbnail.width() - cropped.width()) / 2, (thumbnail.height() - cropped.height()) / 2, cropped.width(), cropped.height());
+    }
+    if (fullSize)
+        *fullSize = size;
+    return thumbnail;
+}
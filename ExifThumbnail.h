@@ -0,0 +1,37 @@
+/***************************************************************************
+ *                                                                         *
+ *   This file is part of the FotoWall project,                            *
+ *       http://code.google.com/p/fotowall                                 *
+ *                                                                         *
+ *   Copyright (C) 2009 by Enrico Ros <enrico.ros@gmail.com>               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __ExifThumbnail_h__
+#define __ExifThumbnail_h__
+
+#include <QImage>
+#include <QSize>
+#include <QString>
+
+/**
+    \brief Reads the small JPEG that cameras embed in the EXIF data
+
+    Only the head of the file is read, so it takes far less than decoding
+    the picture. Cameras often pad the thumbnail to 4:3, so it's cropped to
+    the aspect ratio of the picture (from the EXIF dimensions, else from
+    the JPEG header).
+*/
+class ExifThumbnail
+{
+    public:
+        // a null image if there's none; 'fullSize' gets the size of the picture
+        static QImage read(const QString & filePath, QSize * fullSize = 0);
+};
+
+#endif
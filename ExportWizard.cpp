@@ -14,7 +14,9 @@
 
 #include "ExportWizard.h"
 #include "ui_ExportWizard.h"
+#include "BandedImageWriter.h"
 #include "Desk.h"
+#include "RenderSnapshot.h"
 #include <QDesktopServices>
 #include <QDesktopWidget>
 #include <QDir>
@@ -160,25 +162,45 @@ void ExportWizard::saveImage()
     // get the rendering size
     QSize imageSize(m_ui->saveWidth->value(), m_ui->saveHeight->value());
 
-    // render the image
-    QImage image;
+    // get the rendering mode
+    Qt::AspectRatioMode aspectRatioMode = Qt::IgnoreAspectRatio;
     if (m_ui->ibZoom->isChecked())
-        image = m_desk->renderedImage(imageSize, Qt::KeepAspectRatioByExpanding);
+        aspectRatioMode = Qt::KeepAspectRatioByExpanding;
     else if (m_ui->ibScaleKeep->isChecked())
-        image = m_desk->renderedImage(imageSize, Qt::KeepAspectRatio);
-    else
-        image = m_desk->renderedImage(imageSize, Qt::IgnoreAspectRatio);
-
-    // rotate image if requested
-    if (m_ui->saveLandscape->isChecked()) {
-        // Save in landscape mode, so rotate
-        QMatrix matrix;
-        matrix.rotate(90);
-        image = image.transformed(matrix);
+        aspectRatioMode = Qt::KeepAspectRatio;
+    const bool landscape = m_ui->saveLandscape->isChecked();
+
+    // stream PNG and TIFF files a band at a time, without the whole image in
+    // memory, when the snapshot replays as the scene (see RenderSnapshot)
+    bool saved = false;
+    bool streamed = false;
+    if (BandedImageWriter::canWrite(fileName)) {
+        QSize snapshotSize = imageSize;
+        if (landscape)
+            snapshotSize.transpose();
+        RenderSnapshot snapshot(snapshotSize);
+        m_desk->renderSnapshot(&snapshot, aspectRatioMode, landscape);
+        if (snapshot.isExact()) {
+            saved = BandedImageWriter(fileName).write(snapshot);
+            streamed = true;
+        }
+    }
+    if (!streamed) {
+        // render the image
+        QImage image = m_desk->renderedImage(imageSize, aspectRatioMode);
+
+        // rotate image if requested
+        if (landscape) {
+            // Save in landscape mode, so rotate
+            QMatrix matrix;
+            matrix.rotate(90);
+            image = image.transformed(matrix);
+        }
+        saved = image.save(fileName);
     }
 
     // save image
-    if (image.save(fileName) && QFile::exists(fileName)) {
+    if (saved && QFile::exists(fileName)) {
         int size = QFileInfo(fileName).size();
         QMessageBox::information(this, tr("Done"), tr("The target image is %1 bytes long").arg(size));
     } else
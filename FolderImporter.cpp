@@ -0,0 +1,210 @@
+/***************************************************************************
+ *                                                                         *
+ *   This file is part of the FotoWall project,                            *
+ *       http://code.google.com/p/fotowall                                 *
+ *                                                                         *
+ *   Copyright (C) 2009 by Enrico Ros <enrico.ros@gmail.com>               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "FolderImporter.h"
+#include "CPixmap.h"
+#include "ThumbnailCache.h"
+#include <QDirIterator>
+#include <QImageReader>
+#include <QMetaObject>
+#include <QRunnable>
+#include <QSettings>
+#include <QThread>
+
+// queue lengths: many names, few decoded pictures
+#define FOUND_CAPACITY 256
+#define PROBED_CAPACITY 32
+
+template <typename T>
+FolderImporter::BoundedQueue<T>::BoundedQueue(int capacity)
+    : m_capacity(capacity)
+    , m_closed(false)
+{
+}
+
+template <typename T>
+bool FolderImporter::BoundedQueue<T>::push(const T & item)
+{
+    QMutexLocker locker(&m_mutex);
+    while (m_items.size() >= m_capacity && !m_closed)
+        m_notFull.wait(&m_mutex);
+    if (m_closed)
+        return false;
+    m_items.enqueue(item);
+    m_notEmpty.wakeOne();
+    return true;
+}
+
+template <typename T>
+bool FolderImporter::BoundedQueue<T>::pop(T * item)
+{
+    QMutexLocker locker(&m_mutex);
+    while (m_items.isEmpty() && !m_closed)
+        m_notEmpty.wait(&m_mutex);
+    if (m_items.isEmpty())
+        return false;
+    *item = m_items.dequeue();
+    m_notFull.wakeOne();
+    return true;
+}
+
+template <typename T>
+bool FolderImporter::BoundedQueue<T>::tryPop(T * item, bool * drained)
+{
+    QMutexLocker locker(&m_mutex);
+    *drained = m_items.isEmpty() && m_closed;
+    if (m_items.isEmpty())
+        return false;
+    *item = m_items.dequeue();
+    m_notFull.wakeOne();
+    return true;
+}
+
+template <typename T>
+void FolderImporter::BoundedQueue<T>::close()
+{
+    QMutexLocker locker(&m_mutex);
+    m_closed = true;
+    m_notEmpty.wakeAll();
+    m_notFull.wakeAll();
+}
+
+template <typename T>
+void FolderImporter::BoundedQueue<T>::abort()
+{
+    QMutexLocker locker(&m_mutex);
+    m_items.clear();
+    m_closed = true;
+    m_notEmpty.wakeAll();
+    m_notFull.wakeAll();
+}
+
+// runs a stage in the pool of the importer
+class FolderImporter::Stage : public QRunnable
+{
+    public:
+        Stage(FolderImporter * importer, void (FolderImporter::*function)())
+            : m_importer(importer), m_function(function) {}
+        void run() { (m_importer->*m_function)(); }
+    private:
+        FolderImporter * m_importer;
+        void (FolderImporter::*m_function)();
+};
+
+FolderImporter::FolderImporter(const QStringList & folders, QObject * parent)
+    : QObject(parent)
+    , m_folders(folders)
+    , m_found(FOUND_CAPACITY)
+    , m_probed(PROBED_CAPACITY)
+    , m_decoded(2 * decodeThreads())
+    , m_importedCount(0)
+    , m_finished(false)
+{
+    const int decoders = decodeThreads();
+    m_runningDecoders = decoders;
+    m_pool.setMaxThreadCount(decoders + 2);
+    m_pool.start(new Stage(this, &FolderImporter::enumerate));
+    m_pool.start(new Stage(this, &FolderImporter::probe));
+    for (int i = 0; i < decoders; ++i)
+        m_pool.start(new Stage(this, &FolderImporter::decode));
+}
+
+FolderImporter::~FolderImporter()
+{
+    cancel();
+    m_pool.waitForDone();
+}
+
+int FolderImporter::decodeThreads()
+{
+    QSettings s;
+    return qBound(1, s.value("fotowall/importThreads", qBound(1, QThread::idealThreadCount(), 4)).toInt(), 16);
+}
+
+int FolderImporter::importedCount() const
+{
+    return m_importedCount;
+}
+
+void FolderImporter::cancel()
+{
+    // the stages stop at the next push or pop
+    m_found.abort();
+    m_probed.abort();
+    m_decoded.abort();
+    QMetaObject::invokeMethod(this, "slotDrain", Qt::QueuedConnection);
+}
+
+void FolderImporter::enumerate()
+{
+    QStringList nameFilters;
+    foreach (const QByteArray & format, QImageReader::supportedImageFormats())
+        nameFilters.append("*." + QString::fromLatin1(format));
+    foreach (const QString & folder, m_folders) {
+        QDirIterator it(folder, nameFilters, QDir::Files | QDir::Readable, QDirIterator::Subdirectories | QDirIterator::FollowSymlinks);
+        while (it.hasNext())
+            if (!m_found.push(it.next()))
+                return;
+    }
+    m_found.close();
+}
+
+void FolderImporter::probe()
+{
+    // skip what the name promises but the header doesn't keep
+    QString fileName;
+    while (m_found.pop(&fileName)) {
+        QImageReader reader(fileName);
+        if (reader.canRead() && !m_probed.push(fileName))
+            return;
+    }
+    m_probed.close();
+}
+
+void FolderImporter::decode()
+{
+    QString fileName;
+    while (m_probed.pop(&fileName)) {
+        Decoded decoded;
+        decoded.fileName = fileName;
+        decoded.image = CPixmap::loadForDisplay(fileName, &decoded.fullSize);
+        if (decoded.image.isNull())
+            continue;
+        ThumbnailCache::store(fileName, decoded.image);
+        if (!m_decoded.push(decoded))
+            return;
+        QMetaObject::invokeMethod(this, "slotDrain", Qt::QueuedConnection);
+    }
+
+    // the last decoder out closes the output
+    if (!m_runningDecoders.deref()) {
+        m_decoded.close();
+        QMetaObject::invokeMethod(this, "slotDrain", Qt::QueuedConnection);
+    }
+}
+
+void FolderImporter::slotDrain()
+{
+    Decoded decoded;
+    bool drained = false;
+    while (m_decoded.tryPop(&decoded, &drained)) {
+        ++m_importedCount;
+        emit imported(decoded.fileName, decoded.image, decoded.fullSize);
+    }
+    if (drained && !m_finished) {
+        m_finished = true;
+        emit finished();
+        deleteLater();
+    }
+}
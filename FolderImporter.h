@@ -0,0 +1,100 @@
+/***************************************************************************
+ *                                                                         *
+ *   This file is part of the FotoWall project,                            *
+ *       http://code.google.com/p/fotowall                                 *
+ *                                                                         *
+ *   Copyright (C) 2009 by Enrico Ros <enrico.ros@gmail.com>               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __FolderImporter_h__
+#define __FolderImporter_h__
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QImage>
+#include <QMutex>
+#include <QQueue>
+#include <QSize>
+#include <QStringList>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+/**
+    \brief Imports all the pictures in folders and their subfolders
+
+    A pipeline of stages, linked by bounded queues: a thread enumerates the
+    files, one probes their headers, decodeThreads() decode them at the
+    display size, and the GUI thread gets them by the imported() signal. A
+    stage blocks when the next one lags behind, so huge folders stream at a
+    steady pace with a bounded memory usage. Deletes itself when done.
+*/
+class FolderImporter : public QObject
+{
+    Q_OBJECT
+    public:
+        FolderImporter(const QStringList & folders, QObject * parent = 0);
+        ~FolderImporter();
+
+        // the decoding threads, from the 'fotowall/importThreads' setting
+        static int decodeThreads();
+        int importedCount() const;
+
+    public Q_SLOTS:
+        void cancel();
+
+    Q_SIGNALS:
+        void imported(const QString & fileName, const QImage & image, const QSize & fullSize);
+        void finished();
+
+    private:
+        // a queue that blocks the producers when full and the consumers when
+        // empty, until closed
+        template <typename T> class BoundedQueue {
+            public:
+                BoundedQueue(int capacity);
+                bool push(const T & item);      // false if aborted
+                bool pop(T * item);             // false when closed and empty
+                bool tryPop(T * item, bool * drained);
+                void close();
+                void abort();
+            private:
+                QMutex m_mutex;
+                QWaitCondition m_notFull;
+                QWaitCondition m_notEmpty;
+                QQueue<T> m_items;
+                int m_capacity;
+                bool m_closed;
+        };
+        struct Decoded {
+            QString fileName;
+            QImage image;
+            QSize fullSize;
+        };
+        class Stage;
+        friend class Stage;
+
+        // the stages, each in its own threads
+        void enumerate();
+        void probe();
+        void decode();
+
+        QStringList m_folders;
+        BoundedQueue<QString> m_found;
+        BoundedQueue<QString> m_probed;
+        BoundedQueue<Decoded> m_decoded;
+        QAtomicInt m_runningDecoders;
+        QThreadPool m_pool;
+        int m_importedCount;
+        bool m_finished;
+
+    private Q_SLOTS:
+        void slotDrain();
+};
+
+#endif
@@ -17,6 +17,7 @@
 #include "ui_FotoWall.h"
 #include "Desk.h"
 #include "ExportWizard.h"
+#include "ItemCachePolicy.h"
 #include "XmlRead.h"
 #include "XmlSave.h"
 #include <QAction>
@@ -34,9 +35,11 @@
 #include <QNetworkAccessManager>
 #include <QNetworkRequest>
 #include <QNetworkReply>
+#include <QPaintEvent>
 #include <QPushButton>
 #include <QTimer>
 #include <QVBoxLayout>
+#include <math.h>
 #include "ModeInfo.h"
 #include "ExactSizeDialog.h"
 
@@ -70,10 +73,23 @@ class FWGraphicsView : public QGraphicsView {
         }
 
     protected:
+        void paintEvent(QPaintEvent * event)
+        {
+            // count the cached contents that had to repaint
+            ItemCachePolicy * cachePolicy = ItemCachePolicy::instance();
+            cachePolicy->beginExpose(items(event->rect()));
+            QGraphicsView::paintEvent(event);
+            cachePolicy->endExpose();
+        }
+
         void resizeEvent(QResizeEvent * event)
         {
             m_desk->resize(contentsRect().size());
             QGraphicsView::resizeEvent(event);
+
+            // the view is not scaled by the user: report its scale with the
+            // geometry, so the item caches are picked before it paints
+            ItemCachePolicy::instance()->setZoom(sqrt(fabs(transform().det())));
         }
 
     private:
@@ -141,6 +157,13 @@ FotoWall::~FotoWall()
     // dump current layout
     saveXml(QDir::tempPath() + QDir::separator() + "autosave.fotowall");
 
+#if !defined(QT_NO_DEBUG)
+    // how the item caches did in this session
+    ItemCachePolicy * cachePolicy = ItemCachePolicy::instance();
+    qWarning("FotoWall: item caches: %d hits, %d misses, %d invalidations",
+             cachePolicy->hits(), cachePolicy->misses(), cachePolicy->invalidations());
+#endif
+
     // delete everything
     delete m_view;
     delete m_desk;
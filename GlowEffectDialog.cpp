@@ -17,7 +17,7 @@
 ******************************************************************************/
 
 #include "GlowEffectDialog.h"
-#include "CPixmap.h"
+#include "effects/Blur.h"
 
 GlowEffectDialog::GlowEffectDialog(const QImage & previewImage)
 {
@@ -34,5 +34,5 @@ int GlowEffectDialog::currentRadius() const
 
 QImage GlowEffectDialog::glow(const QImage &image, int radius) const
 {
-    return ui.glowEffectWidget->glow(image, radius);
+    return Blur::glow(image, radius);
 }
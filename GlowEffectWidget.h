@@ -27,6 +27,7 @@
 #include <QPaintEvent>
 #include <QPixmap>
 #include <QImage>
+#include "effects/SummedAreaTable.h"
 
 class GlowEffectWidget : public QWidget
 {
@@ -34,7 +35,6 @@ class GlowEffectWidget : public QWidget
 public:
     GlowEffectWidget(QWidget *parent=0);
     void setPreviewImage(const QImage &preview);
-    QImage glow(const QImage &image, int radius) const;
     void setGlowRadius(int radius);
     int glowRadius() const;
 protected:
@@ -53,6 +53,9 @@ protected:
     void generateLens(const QRectF &bounds);
 private:
     QImage m_image;
+    SummedAreaTable m_imageSums;
+    QImage m_blurred;
+    int m_blurredRadius;
 
     int  m_radius;
 
@@ -0,0 +1,144 @@
+/***************************************************************************
+ *                                                                         *
+ *   This file is part of the FotoWall project,                            *
+ *       http://code.google.com/p/fotowall                                 *
+ *                                                                         *
+ *   Copyright (C) 2009 by Enrico Ros <enrico.ros@gmail.com>               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "ImageCache.h"
+#include <QSettings>
+#include <QStringList>
+
+#define DEFAULT_CACHE_MB 256
+
+// the global image cache instance
+Q_GLOBAL_STATIC(ImageCache, s_imageCacheInstance)
+ImageCache * ImageCache::instance()
+{
+    return s_imageCacheInstance();
+}
+
+ImageCache::ImageCache()
+    : m_hits(0)
+    , m_misses(0)
+    , m_evictions(0)
+{
+    QSettings s;
+    qint64 megaBytes = s.value("fotowall/imageCacheMB", DEFAULT_CACHE_MB).toLongLong();
+    setMaxBytes(megaBytes * 1024 * 1024);
+}
+
+void ImageCache::setMaxBytes(qint64 bytes)
+{
+    m_cache.setMaxCost((int)qBound((qint64)1, bytes / 1024, (qint64)0x7fffffff));
+}
+
+qint64 ImageCache::maxBytes() const
+{
+    return (qint64)m_cache.maxCost() * 1024;
+}
+
+qint64 ImageCache::usedBytes() const
+{
+    return (qint64)m_cache.totalCost() * 1024;
+}
+
+void ImageCache::insert(const QString & key, const QImage & image)
+{
+    if (image.isNull()) {
+        m_cache.remove(key);
+        return;
+    }
+    Entry * entry = new Entry;
+    entry->image = image;
+    insertEntry(key, entry, image.numBytes());
+}
+
+void ImageCache::insert(const QString & key, const QPixmap & pixmap)
+{
+    if (pixmap.isNull()) {
+        m_cache.remove(key);
+        return;
+    }
+    Entry * entry = new Entry;
+    entry->pixmap = pixmap;
+    insertEntry(key, entry, (qint64)pixmap.width() * pixmap.height() * pixmap.depth() / 8);
+}
+
+void ImageCache::insertEntry(const QString & key, Entry * entry, qint64 bytes)
+{
+    // count what QCache drops to make room for the new entry
+    const int countBefore = m_cache.count() + (m_cache.contains(key) ? 0 : 1);
+    m_cache.insert(key, entry, (int)qMax((qint64)1, bytes / 1024));
+    m_evictions += countBefore - m_cache.count();
+}
+
+QImage ImageCache::find(const QString & key)
+{
+    Entry * entry = findEntry(key);
+    return entry ? entry->image : QImage();
+}
+
+QPixmap ImageCache::findPixmap(const QString & key)
+{
+    Entry * entry = findEntry(key);
+    return entry ? entry->pixmap : QPixmap();
+}
+
+ImageCache::Entry * ImageCache::findEntry(const QString & key)
+{
+    Entry * entry = m_cache.object(key);
+    if (!entry) {
+        m_misses++;
+        return 0;
+    }
+    m_hits++;
+    return entry;
+}
+
+void ImageCache::remove(const QString & key)
+{
+    m_cache.remove(key);
+}
+
+void ImageCache::removeGroup(const QString & group)
+{
+    const QString prefix = group + QLatin1Char('/');
+    foreach (const QString & key, m_cache.keys())
+        if (key.startsWith(prefix))
+            m_cache.remove(key);
+}
+
+int ImageCache::count() const
+{
+    return m_cache.count();
+}
+
+int ImageCache::hits() const
+{
+    return m_hits;
+}
+
+int ImageCache::misses() const
+{
+    return m_misses;
+}
+
+int ImageCache::evictions() const
+{
+    return m_evictions;
+}
+
+void ImageCache::resetCounters()
+{
+    m_hits = 0;
+    m_misses = 0;
+    m_evictions = 0;
+}
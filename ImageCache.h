@@ -0,0 +1,73 @@
+/***************************************************************************
+ *                                                                         *
+ *   This file is part of the FotoWall project,                            *
+ *       http://code.google.com/p/fotowall                                 *
+ *                                                                         *
+ *   Copyright (C) 2009 by Enrico Ros <enrico.ros@gmail.com>               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __ImageCache_h__
+#define __ImageCache_h__
+
+#include <QCache>
+#include <QImage>
+#include <QPixmap>
+#include <QString>
+
+/**
+    \brief Memory-budgeted store of decoded images, evicting the least recently used
+
+    Keys are free-form strings; by convention they are '<group>/<name>', so
+    all the entries of an owner can be dropped with removeGroup(). Entries
+    can vanish at any time: the owner must be able to regenerate them.
+    Holds both images and pixmaps (e.g. the scaled copies used to paint),
+    so that a single budget covers all the pixels of the desk; finding an
+    entry makes it the most recently used. Use it from the GUI thread only.
+*/
+class ImageCache
+{
+    public:
+        /// singleton
+        static ImageCache * instance();
+        ImageCache();
+
+        // budget
+        void setMaxBytes(qint64 bytes);
+        qint64 maxBytes() const;
+        qint64 usedBytes() const;
+
+        // entries
+        void insert(const QString & key, const QImage & image);
+        void insert(const QString & key, const QPixmap & pixmap);
+        QImage find(const QString & key);
+        QPixmap findPixmap(const QString & key);
+        void remove(const QString & key);
+        void removeGroup(const QString & group);
+        int count() const;
+
+        // usage counters
+        int hits() const;
+        int misses() const;
+        int evictions() const;
+        void resetCounters();
+
+    private:
+        struct Entry {
+            QImage image;
+            QPixmap pixmap;
+        };
+        void insertEntry(const QString & key, Entry * entry, qint64 bytes);
+        Entry * findEntry(const QString & key);
+        QCache<QString, Entry> m_cache;   // costs are in KBytes
+        int m_hits;
+        int m_misses;
+        int m_evictions;
+};
+
+#endif
@@ -0,0 +1,169 @@
+/***************************************************************************
+ *                                                                         *
+ *   This file is part of the FotoWall project,                            *
+ *       http://code.google.com/p/fotowall                                 *
+ *                                                                         *
+ *   Copyright (C) 2009 by Enrico Ros <enrico.ros@gmail.com>               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "ItemCachePolicy.h"
+#include "frames/Frame.h"
+#include "items/PictureContent.h"
+#include "items/VideoContent.h"
+#include <QPixmapCache>
+#include <QSettings>
+
+#define DEFAULT_CACHE_MB 64
+
+// the global item cache policy instance
+Q_GLOBAL_STATIC(ItemCachePolicy, s_itemCachePolicyInstance)
+ItemCachePolicy * ItemCachePolicy::instance()
+{
+    return s_itemCachePolicyInstance();
+}
+
+ItemCachePolicy::ItemCachePolicy()
+    : m_exposing(false)
+    , m_zoom(1.0)
+    , m_hits(0)
+    , m_misses(0)
+    , m_invalidations(0)
+{
+    // the item caches live in the QPixmapCache: make room for them
+    QSettings s;
+    int kiloBytes = s.value("fotowall/itemCacheMB", DEFAULT_CACHE_MB).toInt() * 1024;
+    if (QPixmapCache::cacheLimit() < kiloBytes)
+        QPixmapCache::setCacheLimit(kiloBytes);
+
+    // a single content can't take more than a quarter of it (32bpp)
+    m_maxItemPixels = (qint64)QPixmapCache::cacheLimit() * 1024 / 4 / 4;
+}
+
+void ItemCachePolicy::setZoom(qreal zoom)
+{
+    if (qFuzzyCompare(m_zoom, zoom))
+        return;
+    m_zoom = zoom;
+    foreach (AbstractContent * content, m_contents)
+        apply(content);
+}
+
+qreal ItemCachePolicy::zoom() const
+{
+    return m_zoom;
+}
+
+void ItemCachePolicy::addContent(AbstractContent * content)
+{
+    if (!m_contents.contains(content))
+        m_contents.append(content);
+    apply(content);
+}
+
+void ItemCachePolicy::removeContent(AbstractContent * content)
+{
+    m_contents.removeAll(content);
+    m_exposed.remove(content);
+    m_painted.remove(content);
+}
+
+QGraphicsItem::CacheMode ItemCachePolicy::modeFor(const AbstractContent * content) const
+{
+    // changing at every frame: the cache would be rendered and thrown away
+    if (content->beingTransformed() || dynamic_cast<const VideoContent *>(content))
+        return QGraphicsItem::NoCache;
+
+    // the device caches grow with the square of the zoom
+    const QRectF bounds = content->sceneBoundingRect();
+    if (bounds.width() * bounds.height() * m_zoom * m_zoom > (qreal)m_maxItemPixels)
+        return QGraphicsItem::NoCache;
+
+    // a plain picture at 1:1 already blits its scaled copy (in the ImageCache)
+    if (dynamic_cast<const PictureContent *>(content) && content->frameClass() == Frame::NoFrame &&
+        content->sceneTransform().type() <= QTransform::TxTranslate && qFuzzyCompare(m_zoom, (qreal)1.0))
+        return QGraphicsItem::NoCache;
+
+    // frames, svg borders, text layouts, smooth transforms
+    return QGraphicsItem::DeviceCoordinateCache;
+}
+
+void ItemCachePolicy::apply(AbstractContent * content)
+{
+    if (!m_contents.contains(content))
+        return;
+    QGraphicsItem::CacheMode mode = modeFor(content);
+    if (content->cacheMode() != mode)
+        content->setCacheMode(mode);
+}
+
+void ItemCachePolicy::invalidate(AbstractContent * content)
+{
+    // pick the mode again (size and transform count), then drop the pixels
+    apply(content);
+    if (content->cacheMode() == QGraphicsItem::NoCache)
+        return;
+    content->update();
+    m_invalidations++;
+}
+
+void ItemCachePolicy::painted(const AbstractContent * content)
+{
+    if (m_exposing)
+        m_painted.insert(content);
+}
+
+void ItemCachePolicy::beginExpose(const QList<QGraphicsItem *> & items)
+{
+    m_exposed.clear();
+    m_painted.clear();
+    foreach (QGraphicsItem * item, items) {
+        if (item->cacheMode() == QGraphicsItem::NoCache || !item->isVisible())
+            continue;
+        if (AbstractContent * content = dynamic_cast<AbstractContent *>(item))
+            m_exposed.insert(content);
+    }
+    m_exposing = !m_exposed.isEmpty();
+}
+
+void ItemCachePolicy::endExpose()
+{
+    if (!m_exposing)
+        return;
+    foreach (const AbstractContent * content, m_exposed) {
+        if (m_painted.contains(content))
+            m_misses++;
+        else
+            m_hits++;
+    }
+    m_exposed.clear();
+    m_painted.clear();
+    m_exposing = false;
+}
+
+int ItemCachePolicy::hits() const
+{
+    return m_hits;
+}
+
+int ItemCachePolicy::misses() const
+{
+    return m_misses;
+}
+
+int ItemCachePolicy::invalidations() const
+{
+    return m_invalidations;
+}
+
+void ItemCachePolicy::resetCounters()
+{
+    m_hits = 0;
+    m_misses = 0;
+    m_invalidations = 0;
+}
@@ -0,0 +1,81 @@
+/***************************************************************************
+ *                                                                         *
+ *   This file is part of the FotoWall project,                            *
+ *       http://code.google.com/p/fotowall                                 *
+ *                                                                         *
+ *   Copyright (C) 2009 by Enrico Ros <enrico.ros@gmail.com>               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __ItemCachePolicy_h__
+#define __ItemCachePolicy_h__
+
+#include <QGraphicsItem>
+#include <QList>
+#include <QSet>
+class AbstractContent;
+
+/**
+    \brief Picks the raster cache mode of the contents, and keeps it valid
+
+    Frames, SVG borders, text layouts and smoothly scaled photos are costly
+    to paint, so the contents are cached in device coordinates, unless:
+    they change at every frame (videos, contents being transformed), or
+    their cache would not fit the pixmap budget at the zoom of the view. The
+    caches are dropped on graphics changes (GFX_CHANGED), transforms and
+    selection changes; renders out of the screen (export, print) don't use
+    them, Qt keeps device caches for the viewports only. The view reports
+    its scale and its exposes: the contents of an expose not painted by it
+    count as hits, the repainted ones as misses.
+    Use it from the GUI thread only.
+*/
+class ItemCachePolicy
+{
+    public:
+        /// singleton
+        static ItemCachePolicy * instance();
+        ItemCachePolicy();
+
+        // the scale of the views: a change picks the modes again. not from
+        // a paint event: the new modes would update() the items mid-paint
+        void setZoom(qreal zoom);
+        qreal zoom() const;
+
+        // contents under the policy
+        void addContent(AbstractContent * content);
+        void removeContent(AbstractContent * content);
+        QGraphicsItem::CacheMode modeFor(const AbstractContent * content) const;
+
+        // notifications from the contents
+        void apply(AbstractContent * content);
+        void invalidate(AbstractContent * content);
+        void painted(const AbstractContent * content);
+
+        // an expose of the view: which cached contents had to repaint
+        void beginExpose(const QList<QGraphicsItem *> & items);
+        void endExpose();
+
+        // usage counters: debug builds print them on exit
+        int hits() const;
+        int misses() const;
+        int invalidations() const;
+        void resetCounters();
+
+    private:
+        QList<AbstractContent *> m_contents;
+        QSet<const AbstractContent *> m_exposed;
+        QSet<const AbstractContent *> m_painted;
+        bool m_exposing;
+        qreal m_zoom;
+        qint64 m_maxItemPixels;
+        int m_hits;
+        int m_misses;
+        int m_invalidations;
+};
+
+#endif
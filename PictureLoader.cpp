@@ -0,0 +1,109 @@
+/***************************************************************************
+ *                                                                         *
+ *   This file is part of the FotoWall project,                            *
+ *       http://code.google.com/p/fotowall                                 *
+ *                                                                         *
+ *   Copyright (C) 2009 by Enrico Ros <enrico.ros@gmail.com>               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "PictureLoader.h"
+#include "CPixmap.h"
+#include "ThumbnailCache.h"
+#include "items/PictureContent.h"
+#include <QThread>
+#include <QtConcurrentRun>
+
+PictureLoader::PictureLoader(QObject * parent)
+    : QObject(parent)
+    , m_maxDecodes(qBound(1, QThread::idealThreadCount(), 4))
+{
+}
+
+PictureLoader::~PictureLoader()
+{
+    // decodes still running will just be discarded
+    qDeleteAll(m_running.keys());
+}
+
+void PictureLoader::load(PictureContent * picture, const QString & fileName)
+{
+    Request request;
+    request.picture = picture;
+    request.fileName = fileName;
+    m_queue.append(request);
+    startDecodes();
+}
+
+int PictureLoader::pendingCount() const
+{
+    int count = m_queue.size();
+    foreach (const QList<Request> & requests, m_running)
+        count += requests.size();
+    return count;
+}
+
+void PictureLoader::setMaxDecodes(int count)
+{
+    m_maxDecodes = qMax(1, count);
+    startDecodes();
+}
+
+int PictureLoader::maxDecodes() const
+{
+    return m_maxDecodes;
+}
+
+void PictureLoader::startDecodes()
+{
+    while (m_running.size() < m_maxDecodes && !m_queue.isEmpty()) {
+        Request request = m_queue.takeFirst();
+        if (!request.picture)
+            continue;
+
+        // the same file is being decoded: share the result
+        QFutureWatcher<Decoded> * watcher = 0;
+        QMap<QFutureWatcher<Decoded> *, QList<Request> >::iterator it = m_running.begin();
+        for (; it != m_running.end() && !watcher; ++it)
+            if (it.value().first().fileName == request.fileName)
+                watcher = it.key();
+        if (watcher) {
+            m_running[watcher].append(request);
+            continue;
+        }
+
+        watcher = new QFutureWatcher<Decoded>();
+        connect(watcher, SIGNAL(finished()), this, SLOT(slotDecoded()));
+        m_running.insert(watcher, QList<Request>() << request);
+        watcher->setFuture(QtConcurrent::run(&PictureLoader::decode, request.fileName));
+    }
+}
+
+PictureLoader::Decoded PictureLoader::decode(const QString & fileName)
+{
+    Decoded decoded;
+    decoded.image = CPixmap::loadForDisplay(fileName, &decoded.fullSize);
+    ThumbnailCache::store(fileName, decoded.image);
+    return decoded;
+}
+
+void PictureLoader::slotDecoded()
+{
+    QFutureWatcher<Decoded> * watcher = static_cast<QFutureWatcher<Decoded> *>(sender());
+    if (!m_running.contains(watcher))
+        return;
+    const QList<Request> requests = m_running.take(watcher);
+    const Decoded decoded = watcher->result();
+    watcher->deleteLater();
+
+    // swap in the (implicitly shared) pixels, or report the failure
+    foreach (const Request & request, requests)
+        if (request.picture && !request.picture->loadDecodedPhoto(request.fileName, decoded.image, decoded.fullSize, true, true))
+            emit loadFailed(request.picture);
+    startDecodes();
+}
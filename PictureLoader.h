@@ -0,0 +1,76 @@
+/***************************************************************************
+ *                                                                         *
+ *   This file is part of the FotoWall project,                            *
+ *       http://code.google.com/p/fotowall                                 *
+ *                                                                         *
+ *   Copyright (C) 2009 by Enrico Ros <enrico.ros@gmail.com>               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __PictureLoader_h__
+#define __PictureLoader_h__
+
+#include <QObject>
+#include <QFutureWatcher>
+#include <QImage>
+#include <QList>
+#include <QMap>
+#include <QPointer>
+#include <QSize>
+#include <QString>
+class PictureContent;
+
+/**
+    \brief Decodes picture files in the background and hands them to the items
+
+    Requests are queued and at most maxDecodes() of them run at the same time
+    on the thread pool, so dropping hundreds of files keeps both the GUI and
+    the memory usage responsive. Files are decoded at the display size (see
+    CPixmap::loadForDisplay). Each picture gets its pixels (in the GUI
+    thread) as soon as its file is decoded, once for all the pictures of the
+    same file; pictures deleted meanwhile are
+    skipped, and the ones whose file can't be read are reported by loadFailed.
+*/
+class PictureLoader : public QObject
+{
+    Q_OBJECT
+    public:
+        PictureLoader(QObject * parent = 0);
+        ~PictureLoader();
+
+        // queue the decode of 'fileName' for 'picture'
+        void load(PictureContent * picture, const QString & fileName);
+        int pendingCount() const;
+
+        void setMaxDecodes(int count);
+        int maxDecodes() const;
+
+    Q_SIGNALS:
+        void loadFailed(PictureContent * picture);
+
+    private:
+        struct Request {
+            QPointer<PictureContent> picture;
+            QString fileName;
+        };
+        struct Decoded {
+            QImage image;
+            QSize fullSize;
+        };
+        void startDecodes();
+        static Decoded decode(const QString & fileName);
+
+        QList<Request> m_queue;
+        QMap<QFutureWatcher<Decoded> *, QList<Request> > m_running;
+        int m_maxDecodes;
+
+    private Q_SLOTS:
+        void slotDecoded();
+};
+
+#endif
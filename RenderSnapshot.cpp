@@ -0,0 +1,824 @@
+/***************************************************************************
+ *                                                                         *
+ *   This file is part of the FotoWall project,                            *
+ *       http://code.google.com/p/fotowall                                 *
+ *                                                                         *
+ *   Copyright (C) 2009 by Enrico Ros <enrico.ros@gmail.com>               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "RenderSnapshot.h"
+#include "ImageCache.h"
+#include <QDataStream>
+#include <QFontDatabase>
+#include <QFontMetricsF>
+#include <QPaintEngine>
+#include <QPainter>
+#include <QPixmap>
+#include <QtConcurrentMap>
+
+#define DEFAULT_TILE_SIDE 512
+
+RenderSnapshot::Command::Command(Type type)
+    : type(type)
+    , value(0)
+    , source(-1)
+    , integer(false)
+    , opacity(1.0)
+{
+}
+
+// textures of pixmaps can't be used out of the GUI thread: keep the image
+static QBrush imageBrush(const QBrush & brush)
+{
+    if (brush.style() != Qt::TexturePattern)
+        return brush;
+    QBrush textured(brush.textureImage());
+    textured.setTransform(brush.transform());
+    return textured;
+}
+
+// records the commands of a painter in the snapshot
+class RenderSnapshot::Engine : public QPaintEngine
+{
+    public:
+        Engine(RenderSnapshot * snapshot)
+            : QPaintEngine(QPaintEngine::AllFeatures)
+            , m_snapshot(snapshot)
+            , m_hints(0)
+        {
+        }
+
+        // ::QPaintEngine
+        bool begin(QPaintDevice *) { return true; }
+        bool end() { return true; }
+        Type type() const { return QPaintEngine::User; }
+
+        void updateState(const QPaintEngineState & state)
+        {
+            // in the order the painter needs them: the clip uses the transform
+            const DirtyFlags flags = state.state();
+            if (flags & DirtyTransform) {
+                Command command(Command::Transform);
+                command.transform = state.transform();
+                command.transform.type();   // computed now, read-only later
+                m_transform = command.transform;
+                append(command);
+            }
+            if (flags & DirtyClipRegion) {
+                Command command(Command::ClipRegion);
+                command.region = state.clipRegion();
+                command.region.rects();     // vectorized now, read-only later
+                command.value = state.clipOperation();
+                append(command);
+            }
+            if (flags & DirtyClipPath) {
+                Command command(Command::ClipPath);
+                command.path = state.clipPath();
+                command.value = state.clipOperation();
+                append(command);
+            }
+            if (flags & DirtyClipEnabled) {
+                Command command(Command::ClipEnabled);
+                command.value = state.isClipEnabled();
+                append(command);
+            }
+            if (flags & DirtyPen) {
+                Command command(Command::Pen);
+                command.pen = state.pen();
+                command.pen.setBrush(imageBrush(command.pen.brush()));
+                m_pen = command.pen;
+                append(command);
+            }
+            if (flags & DirtyBrush) {
+                Command command(Command::Brush);
+                command.brush = imageBrush(state.brush());
+                append(command);
+            }
+            if (flags & DirtyBrushOrigin) {
+                Command command(Command::BrushOrigin);
+                command.point = state.brushOrigin();
+                append(command);
+            }
+            if (flags & DirtyBackground) {
+                Command command(Command::Background);
+                command.brush = imageBrush(state.backgroundBrush());
+                append(command);
+            }
+            if (flags & DirtyBackgroundMode) {
+                Command command(Command::BackgroundMode);
+                command.value = state.backgroundMode();
+                append(command);
+            }
+            if (flags & DirtyHints) {
+                Command command(Command::Hints);
+                command.value = state.renderHints();
+                m_hints = state.renderHints();
+                append(command);
+            }
+            if (flags & DirtyCompositionMode) {
+                Command command(Command::Composition);
+                command.value = state.compositionMode();
+                append(command);
+            }
+            if (flags & DirtyOpacity) {
+                Command command(Command::Opacity);
+                command.opacity = state.opacity();
+                append(command);
+            }
+        }
+
+        void drawRects(const QRect * rects, int rectCount)
+        {
+            appendRects(rects, rectCount, true);
+        }
+
+        void drawRects(const QRectF * rects, int rectCount)
+        {
+            appendRects(rects, rectCount, false);
+        }
+
+        void drawLines(const QLine * lines, int lineCount)
+        {
+            appendLines(lines, lineCount, true);
+        }
+
+        void drawLines(const QLineF * lines, int lineCount)
+        {
+            appendLines(lines, lineCount, false);
+        }
+
+        void drawEllipse(const QRectF & rect)
+        {
+            Command command(Command::Ellipse);
+            command.rect = rect;
+            command.bounds = strokedBounds(rect);
+            append(command);
+        }
+
+        void drawEllipse(const QRect & rect)
+        {
+            Command command(Command::Ellipse);
+            command.rect = rect;
+            command.integer = true;
+            command.bounds = strokedBounds(rect);
+            append(command);
+        }
+
+        void drawPath(const QPainterPath & path)
+        {
+            Command command(Command::Path);
+            command.path = path;
+            command.bounds = strokedBounds(path.controlPointRect());
+            append(command);
+        }
+
+        void drawPoints(const QPointF * points, int pointCount)
+        {
+            appendPoints(Command::Points, points, pointCount, false);
+        }
+
+        void drawPoints(const QPoint * points, int pointCount)
+        {
+            appendPoints(Command::Points, points, pointCount, true);
+        }
+
+        void drawPolygon(const QPointF * points, int pointCount, PolygonDrawMode mode)
+        {
+            appendPoints(Command::Polygon, points, pointCount, false, mode);
+        }
+
+        void drawPolygon(const QPoint * points, int pointCount, PolygonDrawMode mode)
+        {
+            appendPoints(Command::Polygon, points, pointCount, true, mode);
+        }
+
+        void drawPixmap(const QRectF & r, const QPixmap & pm, const QRectF & sr)
+        {
+            drawImage(r, pixmapImage(pm), sr, Qt::AutoColor);
+        }
+
+        void drawTiledPixmap(const QRectF & r, const QPixmap & pixmap, const QPointF & s)
+        {
+            Command command(Command::TiledImage);
+            command.rect = r;
+            command.image = pixmapImage(pixmap);
+            command.point = s;
+            command.bounds = deviceBounds(r, 0);
+            append(command);
+        }
+
+        void drawImage(const QRectF & r, const QImage & image, const QRectF & sr, Qt::ImageConversionFlags flags)
+        {
+            Command command(Command::Image);
+            command.rect = r;
+            command.sourceRect = sr;
+            command.value = flags;
+            command.bounds = deviceBounds(r, 0);
+
+            // the proxy of a source: the source rect is relative to its pixels
+            if (m_snapshot->m_pendingSource != -1 && image.cacheKey() == m_snapshot->m_sourceProxy.cacheKey()) {
+                command.source = m_snapshot->m_pendingSource;
+                m_snapshot->m_pendingSource = -1;
+            } else
+                command.image = image;
+            append(command);
+        }
+
+        void drawTextItem(const QPointF & p, const QTextItem & textItem)
+        {
+            // the painter draws the decorations by itself
+            QFont font = textItem.font();
+            font.setUnderline(false);
+            font.setOverline(false);
+            font.setStrikeOut(false);
+
+            Command command(Command::Text);
+            command.point = p;
+            command.text = textItem.text();
+            command.value = textItem.renderFlags();
+            QDataStream stream(&command.font, QIODevice::WriteOnly);
+            stream << font;
+
+            // generous, to include overhangs of italics
+            QFontMetricsF metrics(font, m_snapshot);
+            QRectF textRect = metrics.boundingRect(command.text).translated(p);
+            textRect |= QRectF(p.x(), textRect.top(), textItem.width(), textRect.height());
+            command.bounds = deviceBounds(textRect, metrics.height());
+
+            // drawText() shapes the run again: if it would not advance as the
+            // recorded one (justified, kerned, ...), keep the pixels instead
+            if (qAbs(metrics.width(command.text) - textItem.width()) > 0.01) {
+                const QRect layerRect = command.bounds.toAlignedRect();
+                QImage layer(layerRect.size(), QImage::Format_ARGB32_Premultiplied);
+                layer.fill(0);
+                QPainter painter(&layer);
+                painter.setRenderHints(QPainter::RenderHints(QFlag(m_hints)));
+                painter.setPen(m_pen);
+                painter.setTransform(m_transform * QTransform::fromTranslate(-layerRect.left(), -layerRect.top()));
+                // by the engine: the painter has recorded the decorations already
+                painter.paintEngine()->drawTextItem(p, textItem);
+                painter.end();
+
+                m_snapshot->m_recordedBytes += layer.numBytes();
+                Command layerCommand(Command::Layer);
+                layerCommand.point = layerRect.topLeft();
+                layerCommand.image = layer;
+                layerCommand.text = command.text;
+                layerCommand.bounds = layerRect;
+                append(layerCommand);
+                m_snapshot->m_exact = false;
+                return;
+            }
+            append(command);
+            m_snapshot->m_hasText = true;
+        }
+
+    private:
+        void append(const Command & command)
+        {
+            m_snapshot->m_commands.append(command);
+        }
+
+        // a pixmap drawn many times (e.g. a frame piece) is converted once
+        QImage pixmapImage(const QPixmap & pixmap)
+        {
+            QHash<qint64, QImage> & images = m_snapshot->m_pixmapImages;
+            QHash<qint64, QImage>::const_iterator it = images.constFind(pixmap.cacheKey());
+            if (it != images.constEnd())
+                return it.value();
+            const QImage image = pixmap.toImage();
+            images.insert(pixmap.cacheKey(), image);
+            m_snapshot->m_recordedBytes += image.numBytes();
+            return image;
+        }
+
+        template <typename Rect> void appendRects(const Rect * rects, int count, bool integer)
+        {
+            Command command(Command::Rects);
+            command.integer = integer;
+            QRectF united;
+            for (int i = 0; i < count; ++i) {
+                const QRectF rect = rects[i];
+                command.points.append(rect.topLeft());
+                command.points.append(QPointF(rect.width(), rect.height()));
+                united |= rect.normalized();
+            }
+            command.bounds = strokedBounds(united);
+            append(command);
+        }
+
+        template <typename Line> void appendLines(const Line * lines, int count, bool integer)
+        {
+            Command command(Command::Lines);
+            command.integer = integer;
+            QRectF united;
+            for (int i = 0; i < count; ++i) {
+                const QLineF line = lines[i];
+                command.points.append(line.p1());
+                command.points.append(line.p2());
+                united |= QRectF(line.p1(), line.p2()).normalized().adjusted(0, 0, 0.001, 0.001);
+            }
+            command.bounds = strokedBounds(united);
+            append(command);
+        }
+
+        template <typename Point> void appendPoints(Command::Type type, const Point * points, int count, bool integer, int mode = 0)
+        {
+            Command command(type);
+            command.integer = integer;
+            command.value = mode;
+            QPolygonF polygon;
+            for (int i = 0; i < count; ++i)
+                polygon.append(QPointF(points[i]));
+            command.points = polygon;
+            command.bounds = strokedBounds(polygon.boundingRect().adjusted(0, 0, 0.001, 0.001));
+            append(command);
+        }
+
+        // device rect of a local one, with 'margin' (device pixels) for the antialiasing
+        QRectF deviceBounds(const QRectF & rect, qreal margin) const
+        {
+            margin += 2.0;
+            return m_transform.mapRect(rect).adjusted(-margin, -margin, margin, margin);
+        }
+
+        // device rect of a local one, with room for the pen: miters stick out
+        // up to 'miterLimit' half widths
+        QRectF strokedBounds(const QRectF & rect) const
+        {
+            if (m_pen.style() == Qt::NoPen)
+                return deviceBounds(rect, 0);
+            qreal width = qMax((qreal)1.0, m_pen.widthF()) * qMax((qreal)1.0, m_pen.miterLimit());
+            if (!m_pen.isCosmetic())
+                width *= qMax(qMax(qAbs(m_transform.m11()), qAbs(m_transform.m12())), qMax(qAbs(m_transform.m21()), qAbs(m_transform.m22())));
+            return deviceBounds(rect, width);
+        }
+
+        RenderSnapshot * m_snapshot;
+        QTransform m_transform;
+        QPen m_pen;
+        int m_hints;
+};
+
+RenderSnapshot::Item::Item(Kind kind)
+    : kind(kind)
+    , frameClass(0)
+    , mirrored(false)
+    , zValue(0.0)
+    , firstCommand(0)
+    , commandCount(0)
+{
+}
+
+RenderSnapshot::RenderSnapshot(const QSize & size)
+    : QPaintDevice()
+    , m_size(size)
+    , m_openItem(-1)
+    , m_hasText(false)
+    , m_exact(true)
+    , m_engine(0)
+    , m_recordedBytes(0)
+    , m_sourceProxy(1, 1, QImage::Format_ARGB32)
+    , m_pendingSource(-1)
+{
+    // lay out like on an image, that is where it will be rendered
+    QImage probe(1, 1, QImage::Format_ARGB32);
+    m_dpiX = probe.logicalDpiX();
+    m_dpiY = probe.logicalDpiY();
+    m_engine = new Engine(this);
+    m_sourceProxy.fill(0);
+
+    // the loaded sources take the budget of the decoded images (in KBytes)
+    m_loadedSources.setMaxCost((int)qMax((qint64)1, ImageCache::instance()->maxBytes() / 1024));
+}
+
+RenderSnapshot::~RenderSnapshot()
+{
+    delete m_engine;
+    qDeleteAll(m_sources);
+    qDeleteAll(m_sourceLocks);
+}
+
+void RenderSnapshot::drawSource(QPainter * painter, const QRectF & target, Source * source)
+{
+    RenderSnapshot * snapshot = dynamic_cast<RenderSnapshot *>(painter->device());
+    if (!snapshot) {
+        painter->drawImage(target, source->load());
+        delete source;
+        return;
+    }
+
+    // the engine records the proxy as a reference to the source
+    snapshot->m_sources.append(source);
+    snapshot->m_sourceLocks.append(new QMutex);
+    snapshot->m_pendingSource = snapshot->m_sources.size() - 1;
+    painter->drawImage(target, snapshot->m_sourceProxy);
+    snapshot->m_pendingSource = -1;
+}
+
+QSize RenderSnapshot::size() const
+{
+    return m_size;
+}
+
+int RenderSnapshot::commandCount() const
+{
+    return m_commands.size();
+}
+
+qint64 RenderSnapshot::recordedBytes() const
+{
+    return m_recordedBytes;
+}
+
+bool RenderSnapshot::isExact() const
+{
+    return m_exact;
+}
+
+void RenderSnapshot::beginItem(const Item & item)
+{
+    if (m_openItem != -1)
+        endItem();
+    m_openItem = m_items.size();
+    m_items.append(item);
+    m_items.last().firstCommand = m_commands.size();
+}
+
+void RenderSnapshot::endItem()
+{
+    if (m_openItem == -1)
+        return;
+
+    // describe what the item painted
+    Item & item = m_items[m_openItem];
+    item.commandCount = m_commands.size() - item.firstCommand;
+    item.bounds = QRectF();
+    item.pixels.clear();
+    item.text.clear();
+    for (int i = item.firstCommand; i < m_commands.size(); ++i) {
+        const Command & command = m_commands.at(i);
+        if (!command.bounds.isNull())
+            item.bounds |= command.bounds;
+        if ((command.type == Command::Image || command.type == Command::TiledImage) && !command.image.isNull())
+            item.pixels.append(command.image);
+        else if (command.type == Command::Text || command.type == Command::Layer)
+            item.text.append(command.text);
+    }
+    m_openItem = -1;
+}
+
+int RenderSnapshot::itemCount() const
+{
+    return m_items.size();
+}
+
+RenderSnapshot::Item RenderSnapshot::item(int index) const
+{
+    return m_items.value(index);
+}
+
+void RenderSnapshot::render(QPainter * painter, const QRect & area) const
+{
+    const QRect visible = area.isNull() ? QRect(QPoint(0, 0), m_size) : area;
+    replayRange(painter, 0, m_commands.size(), visible, QTransform::fromTranslate(-visible.left(), -visible.top()) * painter->worldTransform());
+}
+
+void RenderSnapshot::renderItem(QPainter * painter, int index, const QRect & area) const
+{
+    if (index < 0 || index >= m_items.size() || index == m_openItem)
+        return;
+    const QRect visible = area.isNull() ? QRect(QPoint(0, 0), m_size) : area;
+    replayRange(painter, m_items[index].firstCommand, m_items[index].commandCount, visible,
+                QTransform::fromTranslate(-visible.left(), -visible.top()) * painter->worldTransform());
+}
+
+// the recorded clips making the current one, to apply them again (with the
+// bound) when the clipping is enabled back
+struct RenderSnapshot::ClipState {
+    QList<const Command *> commands;
+    QList<QTransform> transforms;
+    bool enabled;
+
+    ClipState() : enabled(false) {}
+
+    static void apply(QPainter * painter, const Command & command, Qt::ClipOperation op)
+    {
+        if (command.type == Command::ClipRegion)
+            painter->setClipRegion(command.region, op);
+        else
+            painter->setClipPath(command.path, op);
+    }
+
+    // intersect (or replace) the clip with 'rect', in device coordinates
+    static void bound(QPainter * painter, const QRect & rect, Qt::ClipOperation op = Qt::IntersectClip)
+    {
+        const QTransform world = painter->worldTransform();
+        painter->setWorldTransform(QTransform());
+        painter->setClipRect(rect, op);
+        painter->setWorldTransform(world);
+    }
+};
+
+void RenderSnapshot::replayRange(QPainter * painter, int first, int count, const QRect & area, const QTransform & base, const QRect & bound) const
+{
+    ClipState clip;
+    painter->save();
+    painter->setWorldTransform(base);
+    for (int i = 0; i < first + count; ++i) {
+        // before the range, just the state: an item starts from the one left by the previous
+        const Command & command = m_commands.at(i);
+        if (i < first && command.type > Command::Opacity)
+            continue;
+        if (command.bounds.isNull() || command.bounds.intersects(area))
+            replay(painter, command, base, bound, clip);
+    }
+    painter->restore();
+}
+
+QImage RenderSnapshot::sourceImage(int index) const
+{
+    // one thread loads a source, the others needing it wait for it
+    QMutexLocker loading(m_sourceLocks.at(index));
+    {
+        QMutexLocker locker(&m_loadedMutex);
+        if (const QImage * image = m_loadedSources.object(index))
+            return *image;
+    }
+    const QImage image = m_sources.at(index)->load();
+    QMutexLocker locker(&m_loadedMutex);
+    m_loadedSources.insert(index, new QImage(image), qMax(1, image.numBytes() / 1024));
+    return image;
+}
+
+void RenderSnapshot::replay(QPainter * painter, const Command & command, const QTransform & base, const QRect & bound, ClipState & clip) const
+{
+    switch (command.type) {
+        case Command::Transform:
+            painter->setWorldTransform(command.transform * base);
+            break;
+        case Command::ClipRegion:
+        case Command::ClipPath: {
+            const Qt::ClipOperation op = (Qt::ClipOperation)command.value;
+            ClipState::apply(painter, command, op);
+            if (bound.isNull())
+                break;
+            // QPainter replaces a disabled clip: so does the bounded one
+            if (op != Qt::IntersectClip || !clip.enabled) {
+                clip.commands.clear();
+                clip.transforms.clear();
+            }
+            clip.enabled = op != Qt::NoClip;
+            if (clip.enabled) {
+                clip.commands.append(&command);
+                clip.transforms.append(painter->worldTransform());
+            }
+            if (op != Qt::IntersectClip)
+                ClipState::bound(painter, bound);
+            } break;
+        case Command::ClipEnabled:
+            if (bound.isNull()) {
+                painter->setClipping(command.value);
+                break;
+            }
+            clip.enabled = command.value;
+            if (clip.enabled) {
+                const QTransform world = painter->worldTransform();
+                for (int i = 0; i < clip.commands.size(); ++i) {
+                    painter->setWorldTransform(clip.transforms.at(i));
+                    ClipState::apply(painter, *clip.commands.at(i), i ? (Qt::ClipOperation)clip.commands.at(i)->value : Qt::ReplaceClip);
+                }
+                painter->setWorldTransform(world);
+                ClipState::bound(painter, bound);
+            } else
+                ClipState::bound(painter, bound, Qt::ReplaceClip);
+            break;
+        case Command::Pen:
+            painter->setPen(command.pen);
+            break;
+        case Command::Brush:
+            painter->setBrush(command.brush);
+            break;
+        case Command::BrushOrigin:
+            painter->setBrushOrigin(command.point);
+            break;
+        case Command::Background:
+            painter->setBackground(command.brush);
+            break;
+        case Command::BackgroundMode:
+            painter->setBackgroundMode((Qt::BGMode)command.value);
+            break;
+        case Command::Hints:
+            painter->setRenderHints(painter->renderHints(), false);
+            painter->setRenderHints(QPainter::RenderHints(QFlag(command.value)), true);
+            break;
+        case Command::Composition:
+            painter->setCompositionMode((QPainter::CompositionMode)command.value);
+            break;
+        case Command::Opacity:
+            painter->setOpacity(command.opacity);
+            break;
+
+        case Command::Rects: {
+            const QVector<QPointF> & points = command.points;
+            if (command.integer) {
+                QVector<QRect> rects;
+                for (int i = 0; i + 1 < points.size(); i += 2)
+                    rects.append(QRectF(points[i], QSizeF(points[i + 1].x(), points[i + 1].y())).toRect());
+                painter->drawRects(rects);
+            } else {
+                QVector<QRectF> rects;
+                for (int i = 0; i + 1 < points.size(); i += 2)
+                    rects.append(QRectF(points[i], QSizeF(points[i + 1].x(), points[i + 1].y())));
+                painter->drawRects(rects);
+            }
+            } break;
+        case Command::Lines: {
+            const QVector<QPointF> & points = command.points;
+            if (command.integer) {
+                QVector<QLine> lines;
+                for (int i = 0; i + 1 < points.size(); i += 2)
+                    lines.append(QLineF(points[i], points[i + 1]).toLine());
+                painter->drawLines(lines);
+            } else {
+                QVector<QLineF> lines;
+                for (int i = 0; i + 1 < points.size(); i += 2)
+                    lines.append(QLineF(points[i], points[i + 1]));
+                painter->drawLines(lines);
+            }
+            } break;
+        case Command::Ellipse:
+            if (command.integer)
+                painter->drawEllipse(command.rect.toRect());
+            else
+                painter->drawEllipse(command.rect);
+            break;
+        case Command::Points:
+            if (command.integer)
+                painter->drawPoints(QPolygonF(command.points).toPolygon());
+            else
+                painter->drawPoints(QPolygonF(command.points));
+            break;
+        case Command::Polygon: {
+            const QPolygonF polygon(command.points);
+            switch (command.value) {
+                case QPaintEngine::OddEvenMode:
+                case QPaintEngine::WindingMode: {
+                    const Qt::FillRule rule = command.value == QPaintEngine::WindingMode ? Qt::WindingFill : Qt::OddEvenFill;
+                    if (command.integer)
+                        painter->drawPolygon(polygon.toPolygon(), rule);
+                    else
+                        painter->drawPolygon(polygon, rule);
+                    } break;
+                case QPaintEngine::ConvexMode:
+                    if (command.integer)
+                        painter->drawConvexPolygon(polygon.toPolygon());
+                    else
+                        painter->drawConvexPolygon(polygon);
+                    break;
+                case QPaintEngine::PolylineMode:
+                    if (command.integer)
+                        painter->drawPolyline(polygon.toPolygon());
+                    else
+                        painter->drawPolyline(polygon);
+                    break;
+            }
+            } break;
+        case Command::Path: {
+            // the engines cache data in the path: use a private copy
+            QPainterPath path;
+            path.addPath(command.path);
+            path.setFillRule(command.path.fillRule());
+            painter->drawPath(path);
+            } break;
+        case Command::Image:
+            if (command.source != -1) {
+                const QImage pixels = sourceImage(command.source);
+                const QRectF & s = command.sourceRect;
+                const QRectF sourceRect(s.left() * pixels.width(), s.top() * pixels.height(), s.width() * pixels.width(), s.height() * pixels.height());
+                painter->drawImage(command.rect, pixels, sourceRect, Qt::ImageConversionFlags(QFlag(command.value)));
+            } else
+                painter->drawImage(command.rect, command.image, command.sourceRect, Qt::ImageConversionFlags(QFlag(command.value)));
+            break;
+        case Command::TiledImage:
+            painter->save();
+            painter->setPen(Qt::NoPen);
+            painter->setBrush(QBrush(command.image));
+            painter->setBrushOrigin(command.rect.topLeft() - command.point);
+            painter->drawRect(command.rect);
+            painter->restore();
+            break;
+        case Command::Text: {
+            // a private font too, fonts are not shareable among threads
+            QFont font;
+            QDataStream stream(command.font);
+            stream >> font;
+            painter->save();
+            painter->setFont(font);
+            painter->setLayoutDirection((command.value & QTextItem::RightToLeft) ? Qt::RightToLeft : Qt::LeftToRight);
+            painter->drawText(command.point, command.text);
+            painter->restore();
+            } break;
+        case Command::Layer:
+            // already in device pixels
+            painter->save();
+            painter->setWorldTransform(base);
+            painter->drawImage(command.point, command.image);
+            painter->restore();
+            break;
+    }
+}
+
+// a tile of the output, rendered straight into the pixels of the image. the
+// view starts at the pixel (0, 0) of the snapshot, out of the image when it
+// shows an area: only the tile is painted, with the coordinates (and so the
+// rasterization) of a direct render
+struct RenderSnapshot::Tile {
+    const RenderSnapshot * snapshot;
+    uchar * origin;
+    int bytesPerLine;
+    QImage::Format format;
+    QSize viewSize;
+    QRect rect;     // in the snapshot
+};
+
+void RenderSnapshot::renderTile(const Tile & tile)
+{
+    QImage view(tile.origin, tile.viewSize.width(), tile.viewSize.height(), tile.bytesPerLine, tile.format);
+    QPainter painter(&view);
+    painter.setClipRect(tile.rect);
+    tile.snapshot->replayRange(&painter, 0, tile.snapshot->m_commands.size(), tile.rect, QTransform(), tile.rect);
+    painter.end();
+}
+
+QImage RenderSnapshot::toImage(const QRect & area, int tileSide, QImage::Format format) const
+{
+    const QRect visible = area.isNull() ? QRect(QPoint(0, 0), m_size) : area;
+    QImage result(visible.size(), format);
+    if (result.isNull())
+        return result;
+    result.fill(0);
+    if (tileSide < 1)
+        tileSide = DEFAULT_TILE_SIDE;
+
+    // the tiles write disjoint pixels of the same image
+    const int bytesPerLine = result.bytesPerLine();
+    uchar * origin = result.bits() - ((qint64)visible.top() * bytesPerLine + visible.left() * (result.depth() / 8));
+    QList<Tile> tiles;
+    for (int y = visible.top(); y <= visible.bottom(); y += tileSide) {
+        for (int x = visible.left(); x <= visible.right(); x += tileSide) {
+            Tile tile;
+            tile.snapshot = this;
+            tile.origin = origin;
+            tile.bytesPerLine = bytesPerLine;
+            tile.format = format;
+            tile.viewSize = QSize(visible.right() + 1, visible.bottom() + 1);
+            tile.rect = QRect(x, y, qMin(tileSide, visible.right() + 1 - x), qMin(tileSide, visible.bottom() + 1 - y));
+            tiles.append(tile);
+        }
+    }
+
+    // text needs a font engine per thread
+    if (m_hasText && !QFontDatabase::supportsThreadedFontRendering()) {
+        foreach (const Tile & tile, tiles)
+            renderTile(tile);
+    } else
+        QtConcurrent::blockingMap(tiles, renderTile);
+    return result;
+}
+
+QPaintEngine * RenderSnapshot::paintEngine() const
+{
+    return m_engine;
+}
+
+int RenderSnapshot::metric(PaintDeviceMetric metric) const
+{
+    switch (metric) {
+        case PdmWidth:
+            return m_size.width();
+        case PdmHeight:
+            return m_size.height();
+        case PdmWidthMM:
+            return qRound(m_size.width() * 25.4 / m_dpiX);
+        case PdmHeightMM:
+            return qRound(m_size.height() * 25.4 / m_dpiY);
+        case PdmNumColors:
+            return 0;
+        case PdmDepth:
+            return 32;
+        case PdmDpiX:
+        case PdmPhysicalDpiX:
+            return m_dpiX;
+        case PdmDpiY:
+        case PdmPhysicalDpiY:
+            return m_dpiY;
+    }
+    return 0;
+}
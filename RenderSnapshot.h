@@ -0,0 +1,188 @@
+/***************************************************************************
+ *                                                                         *
+ *   This file is part of the FotoWall project,                            *
+ *       http://code.google.com/p/fotowall                                 *
+ *                                                                         *
+ *   Copyright (C) 2009 by Enrico Ros <enrico.ros@gmail.com>               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __RenderSnapshot_h__
+#define __RenderSnapshot_h__
+
+#include <QPaintDevice>
+#include <QBrush>
+#include <QCache>
+#include <QHash>
+#include <QImage>
+#include <QList>
+#include <QMutex>
+#include <QPainterPath>
+#include <QPen>
+#include <QRegion>
+#include <QSize>
+#include <QString>
+#include <QStringList>
+#include <QTransform>
+#include <QVector>
+class QPainter;
+class QPaintEngine;
+
+/**
+    \brief A paint device recording the drawing commands, to replay them later
+
+    Paint the scene on it once (GUI thread), then rasterize it with render()
+    or toImage() from any number of threads: pixmaps are recorded as images
+    and the shared data is made read-only, so the recording does not depend
+    on the live items anymore. Large pixels (the full resolution of the
+    photos) are not recorded: they are drawn with drawSource() and loaded
+    while replaying, the loaded ones kept within the ImageCache budget.
+    toImage() splits the target in tiles and renders them in parallel,
+    straight into the final image: every tile paints at the device
+    coordinates of a direct render, clipped to the tile, so the pixels are
+    the ones of painting the scene on the image (tests/rendersnapshot).
+
+    Text runs are replayed by drawText() when the font lays them out as the
+    recorded run (same advance), else they are rasterized while recording,
+    in device pixels, and blended on replay: the snapshot is not exact
+    anymore (isExact()), paint the scene directly where that matters.
+
+    The commands are grouped by the item that painted them (see beginItem()),
+    in stacking order, each with its description: a render list that can be
+    inspected or rendered an item at a time while the scene keeps changing.
+*/
+class RenderSnapshot : public QPaintDevice
+{
+    public:
+        RenderSnapshot(const QSize & size);
+        ~RenderSnapshot();
+
+        QSize size() const;
+        int commandCount() const;
+
+        // bytes of the pixels made by the recording: pixmaps converted to
+        // images (once per pixmap) and the rasterized text runs
+        qint64 recordedBytes() const;
+
+        // true if the replay has the pixels of a direct render (see above)
+        bool isExact() const;
+
+        // pixels to be loaded while replaying, instead of recorded
+        class Source
+        {
+            public:
+                virtual ~Source() {}
+                // called from any thread, at any time: must be reentrant
+                virtual QImage load() const = 0;
+        };
+
+        // draw 'source' into 'target': recorded by reference on a snapshot,
+        // loaded and drawn now on the other devices. takes 'source'.
+        static void drawSource(QPainter * painter, const QRectF & target, Source * source);
+
+        // what an item of the scene left in the snapshot
+        struct Item {
+            enum Kind { Background, Content, Mirror, Foreground, Other };
+            Kind kind;
+            QString className;      // of the content
+            quint32 frameClass;
+            bool mirrored;
+            qreal zValue;
+            QTransform transform;   // from the item to the snapshot
+            QRectF bounds;          // on the snapshot, of the drawing
+            QList<QImage> pixels;   // images: the item's own, pixmaps: copies (see recordedBytes())
+            QStringList text;       // the laid out runs
+            int firstCommand;
+            int commandCount;
+
+            Item(Kind kind = Other);
+        };
+
+        // the commands painted between the calls belong to 'item' (GUI thread)
+        void beginItem(const Item & item);
+        void endItem();
+        int itemCount() const;
+        Item item(int index) const;
+
+        // replay the 'area' of the snapshot at (0, 0) of 'painter' (any thread)
+        void render(QPainter * painter, const QRect & area = QRect()) const;
+        void renderItem(QPainter * painter, int index, const QRect & area = QRect()) const;
+
+        // rasterize the 'area' of the snapshot (all if null), in tiles rendered by all the cores
+        QImage toImage(const QRect & area = QRect(), int tileSide = 0, QImage::Format format = QImage::Format_ARGB32) const;
+
+        // ::QPaintDevice
+        QPaintEngine * paintEngine() const;
+
+    protected:
+        int metric(PaintDeviceMetric metric) const;
+
+    private:
+        Q_DISABLE_COPY(RenderSnapshot)
+        struct Command {
+            enum Type {
+                // state
+                Transform, ClipRegion, ClipPath, ClipEnabled, Pen, Brush, BrushOrigin,
+                Background, BackgroundMode, Hints, Composition, Opacity,
+                // drawing
+                Rects, Lines, Ellipse, Points, Polygon, Path, Image, TiledImage, Text, Layer
+            } type;
+            int value;              // op, mode or flags
+            int source;             // of the Image, -1 if recorded
+            bool integer;           // recorded from int geometry
+            qreal opacity;
+            QTransform transform;
+            QRegion region;
+            QPainterPath path;
+            QPen pen;
+            QBrush brush;
+            QPointF point;
+            QRectF rect;
+            QRectF sourceRect;
+            QVector<QPointF> points;
+            QImage image;
+            QByteArray font;
+            QString text;
+            QRectF bounds;          // on the device, null if unknown
+
+            Command(Type type);
+        };
+        class Engine;
+        friend class Engine;
+
+        struct ClipState;
+        struct Tile;
+
+        // 'bound' (device) contains the painting, whatever clips are recorded
+        void replayRange(QPainter * painter, int first, int count, const QRect & area, const QTransform & base, const QRect & bound = QRect()) const;
+        void replay(QPainter * painter, const Command & command, const QTransform & base, const QRect & bound, ClipState & clip) const;
+        static void renderTile(const Tile & tile);
+        QImage sourceImage(int index) const;
+
+        QSize m_size;
+        int m_dpiX;
+        int m_dpiY;
+        QList<Command> m_commands;
+        QList<Item> m_items;
+        int m_openItem;
+        bool m_hasText;
+        bool m_exact;
+        Engine * m_engine;
+        QHash<qint64, QImage> m_pixmapImages;   // by QPixmap::cacheKey()
+        qint64 m_recordedBytes;
+
+        // the sources and the ones loaded, shared by the replaying threads
+        QImage m_sourceProxy;
+        int m_pendingSource;
+        QList<Source *> m_sources;
+        QList<QMutex *> m_sourceLocks;
+        mutable QCache<int, QImage> m_loadedSources;
+        mutable QMutex m_loadedMutex;
+};
+
+#endif
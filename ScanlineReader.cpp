@@ -0,0 +1,366 @@
+/***************************************************************************
+ *                                                                         *
+ *   This file is part of the FotoWall project,                            *
+ *       http://code.google.com/p/fotowall                                 *
+ *                                                                         *
+ *   Copyright (C) 2009 by Enrico Ros <enrico.ros@gmail.com>               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "ScanlineReader.h"
+#include <QFile>
+#include <QVector>
+#include <setjmp.h>
+#include <stdio.h>
+
+#if defined(HAS_LIBJPEG)
+extern "C" {
+#include <jpeglib.h>
+}
+#endif
+#if defined(HAS_LIBPNG)
+#include <png.h>
+#endif
+#if defined(HAS_LIBTIFF)
+#include <tiffio.h>
+#endif
+
+ScanlineReader::ScanlineReader()
+    : m_format(QImage::Format_RGB32)
+    , m_row(0)
+{
+}
+
+ScanlineReader::~ScanlineReader()
+{
+}
+
+QSize ScanlineReader::size() const
+{
+    return m_size;
+}
+
+QImage::Format ScanlineReader::format() const
+{
+    return m_format;
+}
+
+bool ScanlineReader::read(QImage & band, int rows)
+{
+    if (rows < 1 || m_row + rows > m_size.height() || band.format() != m_format ||
+        band.width() < m_size.width() || band.height() < rows)
+        return false;
+    if (!readRows(band, rows))
+        return false;
+    m_row += rows;
+    return true;
+}
+
+
+#if defined(HAS_LIBJPEG)
+// libjpeg reports the errors by a jump back to the caller
+struct JpegError {
+    jpeg_error_mgr manager;
+    jmp_buf jump;
+};
+
+static void jpegErrorExit(j_common_ptr info)
+{
+    longjmp(((JpegError *)info->err)->jump, 1);
+}
+
+static void jpegOutputMessage(j_common_ptr)
+{
+}
+
+class JpegScanlineReader : public ScanlineReader
+{
+    public:
+        JpegScanlineReader()
+            : m_file(0)
+            , m_created(false)
+        {
+        }
+
+        ~JpegScanlineReader()
+        {
+            if (m_created)
+                jpeg_destroy_decompress(&m_info);
+            if (m_file)
+                fclose(m_file);
+        }
+
+        bool open(const QString & filePath)
+        {
+            m_file = fopen(QFile::encodeName(filePath).constData(), "rb");
+            if (!m_file)
+                return false;
+            m_info.err = jpeg_std_error(&m_error.manager);
+            m_error.manager.error_exit = jpegErrorExit;
+            m_error.manager.output_message = jpegOutputMessage;
+            if (setjmp(m_error.jump))
+                return false;
+            jpeg_create_decompress(&m_info);
+            m_created = true;
+            jpeg_stdio_src(&m_info, m_file);
+            jpeg_read_header(&m_info, TRUE);
+
+            // libjpeg converts YCbCr only: gray and CMYK are expanded here
+            switch (m_info.jpeg_color_space) {
+                case JCS_GRAYSCALE:
+                    m_info.out_color_space = JCS_GRAYSCALE;
+                    break;
+                case JCS_CMYK:
+                case JCS_YCCK:
+                    m_info.out_color_space = JCS_CMYK;
+                    break;
+                default:
+                    m_info.out_color_space = JCS_RGB;
+                    break;
+            }
+            jpeg_start_decompress(&m_info);
+            m_size = QSize(m_info.output_width, m_info.output_height);
+            m_format = QImage::Format_RGB32;
+            m_line.resize(m_info.output_width * m_info.output_components);
+            return !m_size.isEmpty();
+        }
+
+    protected:
+        bool readRows(QImage & band, int rows)
+        {
+            if (setjmp(m_error.jump))
+                return false;
+            const int components = m_info.output_components;
+            for (int y = 0; y < rows; ++y) {
+                JSAMPROW line = m_line.data();
+                if (jpeg_read_scanlines(&m_info, &line, 1) != 1)
+                    return false;
+                const uchar * in = m_line.constData();
+                QRgb * out = (QRgb *)band.scanLine(y);
+                for (int x = 0; x < m_size.width(); ++x, in += components) {
+                    if (components == 1)
+                        out[x] = qRgb(in[0], in[0], in[0]);
+                    else if (components == 4)   // inverted, as written by Adobe (and read by Qt)
+                        out[x] = qRgb(in[0] * in[3] / 255, in[1] * in[3] / 255, in[2] * in[3] / 255);
+                    else
+                        out[x] = qRgb(in[0], in[1], in[2]);
+                }
+            }
+            return true;
+        }
+
+    private:
+        FILE * m_file;
+        jpeg_decompress_struct m_info;
+        JpegError m_error;
+        bool m_created;
+        QVector<JSAMPLE> m_line;
+};
+#endif
+
+
+#if defined(HAS_LIBPNG)
+static void pngError(png_structp png, png_const_charp)
+{
+    longjmp(png_jmpbuf(png), 1);
+}
+
+static void pngWarning(png_structp, png_const_charp)
+{
+}
+
+class PngScanlineReader : public ScanlineReader
+{
+    public:
+        PngScanlineReader()
+            : m_file(0)
+            , m_png(0)
+            , m_info(0)
+        {
+        }
+
+        ~PngScanlineReader()
+        {
+            if (m_png)
+                png_destroy_read_struct(&m_png, m_info ? &m_info : 0, 0);
+            if (m_file)
+                fclose(m_file);
+        }
+
+        bool open(const QString & filePath)
+        {
+            m_file = fopen(QFile::encodeName(filePath).constData(), "rb");
+            if (!m_file)
+                return false;
+            png_byte signature[8];
+            if (fread(signature, 1, 8, m_file) != 8 || png_sig_cmp(signature, 0, 8))
+                return false;
+            m_png = png_create_read_struct(PNG_LIBPNG_VER_STRING, 0, pngError, pngWarning);
+            if (!m_png)
+                return false;
+            m_info = png_create_info_struct(m_png);
+            if (!m_info)
+                return false;
+            if (setjmp(png_jmpbuf(m_png)))
+                return false;
+            png_init_io(m_png, m_file);
+            png_set_sig_bytes(m_png, 8);
+            png_read_info(m_png, m_info);
+
+            // interlaced rows come in passes over the whole image
+            png_uint_32 width, height;
+            int depth, colorType, interlace;
+            png_get_IHDR(m_png, m_info, &width, &height, &depth, &colorType, &interlace, 0, 0);
+            if (interlace != PNG_INTERLACE_NONE)
+                return false;
+
+            // everything to 8 bit RGBA
+            const bool alpha = (colorType & PNG_COLOR_MASK_ALPHA) || png_get_valid(m_png, m_info, PNG_INFO_tRNS);
+            png_set_expand(m_png);
+            png_set_strip_16(m_png);
+            if (colorType == PNG_COLOR_TYPE_GRAY || colorType == PNG_COLOR_TYPE_GRAY_ALPHA)
+                png_set_gray_to_rgb(m_png);
+            if (!alpha)
+                png_set_filler(m_png, 0xff, PNG_FILLER_AFTER);
+            png_read_update_info(m_png, m_info);
+            if (png_get_rowbytes(m_png, m_info) != width * 4)
+                return false;
+            m_size = QSize(width, height);
+            m_format = alpha ? QImage::Format_ARGB32 : QImage::Format_RGB32;
+            m_line.resize(width * 4);
+            return !m_size.isEmpty();
+        }
+
+    protected:
+        bool readRows(QImage & band, int rows)
+        {
+            if (setjmp(png_jmpbuf(m_png)))
+                return false;
+            for (int y = 0; y < rows; ++y) {
+                png_read_row(m_png, m_line.data(), 0);
+                const png_byte * in = m_line.constData();
+                QRgb * out = (QRgb *)band.scanLine(y);
+                for (int x = 0; x < m_size.width(); ++x, in += 4)
+                    out[x] = qRgba(in[0], in[1], in[2], in[3]);
+            }
+            return true;
+        }
+
+    private:
+        FILE * m_file;
+        png_structp m_png;
+        png_infop m_info;
+        QVector<png_byte> m_line;
+};
+#endif
+
+
+#if defined(HAS_LIBTIFF)
+class TiffScanlineReader : public ScanlineReader
+{
+    public:
+        TiffScanlineReader()
+            : m_tiff(0)
+            , m_begun(false)
+        {
+        }
+
+        ~TiffScanlineReader()
+        {
+            if (m_begun)
+                TIFFRGBAImageEnd(&m_image);
+            if (m_tiff)
+                TIFFClose(m_tiff);
+        }
+
+        bool open(const QString & filePath)
+        {
+            m_tiff = TIFFOpen(QFile::encodeName(filePath).constData(), "r");
+            if (!m_tiff)
+                return false;
+
+            // the bands are read from the first row of the file: it has to be the top one
+            quint16 orientation = ORIENTATION_TOPLEFT;
+            TIFFGetFieldDefaulted(m_tiff, TIFFTAG_ORIENTATION, &orientation);
+            char message[1024];
+            if (orientation != ORIENTATION_TOPLEFT || !TIFFRGBAImageOK(m_tiff, message) ||
+                !TIFFRGBAImageBegin(&m_image, m_tiff, 0, message))
+                return false;
+            m_begun = true;
+            m_image.req_orientation = ORIENTATION_TOPLEFT;
+            m_size = QSize(m_image.width, m_image.height);
+            m_format = m_image.alpha ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32;
+            return !m_size.isEmpty();
+        }
+
+    protected:
+        bool readRows(QImage & band, int rows)
+        {
+            // libtiff fills the rows as ABGR words, with associated alpha
+            m_raster.resize(m_size.width() * rows);
+            m_image.row_offset = m_row;
+            m_image.col_offset = 0;
+            if (!TIFFRGBAImageGet(&m_image, m_raster.data(), m_size.width(), rows))
+                return false;
+            const quint32 * in = m_raster.constData();
+            for (int y = 0; y < rows; ++y) {
+                QRgb * out = (QRgb *)band.scanLine(y);
+                for (int x = 0; x < m_size.width(); ++x, ++in)
+                    out[x] = qRgba(TIFFGetR(*in), TIFFGetG(*in), TIFFGetB(*in), m_image.alpha ? TIFFGetA(*in) : 255);
+            }
+            return true;
+        }
+
+    private:
+        TIFF * m_tiff;
+        TIFFRGBAImage m_image;
+        bool m_begun;
+        QVector<quint32> m_raster;
+};
+#endif
+
+
+ScanlineReader * ScanlineReader::create(const QString & filePath)
+{
+    // by the signature, not by the suffix
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly))
+        return 0;
+    const QByteArray magic = file.read(4);
+    file.close();
+
+#if defined(HAS_LIBJPEG)
+    if (magic.startsWith("\xFF\xD8")) {
+        JpegScanlineReader * reader = new JpegScanlineReader;
+        if (reader->open(filePath))
+            return reader;
+        delete reader;
+        return 0;
+    }
+#endif
+#if defined(HAS_LIBPNG)
+    if (magic.startsWith("\x89PNG")) {
+        PngScanlineReader * reader = new PngScanlineReader;
+        if (reader->open(filePath))
+            return reader;
+        delete reader;
+        return 0;
+    }
+#endif
+#if defined(HAS_LIBTIFF)
+    if (magic == QByteArray("II*\0", 4) || magic == QByteArray("MM\0*", 4)) {
+        TiffScanlineReader * reader = new TiffScanlineReader;
+        if (reader->open(filePath))
+            return reader;
+        delete reader;
+        return 0;
+    }
+#endif
+    Q_UNUSED(magic);
+    return 0;
+}
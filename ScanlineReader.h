@@ -0,0 +1,54 @@
+/***************************************************************************
+ *                                                                         *
+ *   This file is part of the FotoWall project,                            *
+ *       http://code.google.com/p/fotowall                                 *
+ *                                                                         *
+ *   Copyright (C) 2009 by Enrico Ros <enrico.ros@gmail.com>               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __ScanlineReader_h__
+#define __ScanlineReader_h__
+
+#include <QImage>
+#include <QSize>
+#include <QString>
+
+/**
+    \brief Decodes an image file from the top, a band of rows at a time
+
+    QImageReader decodes whole images: this reads them in a single pass
+    keeping just one band in memory, for the formats the system libraries
+    can stream: JPEG (HAS_LIBJPEG), non-interlaced PNG (HAS_LIBPNG) and
+    top-down TIFF (HAS_LIBTIFF), each enabled by a CONFIG switch of the
+    build (stream_jpeg, stream_png, stream_tiff). Reentrant: use an
+    instance per thread.
+*/
+class ScanlineReader
+{
+    public:
+        // a reader for 'filePath', or 0 if its format can't be streamed
+        static ScanlineReader * create(const QString & filePath);
+        virtual ~ScanlineReader();
+
+        QSize size() const;
+        QImage::Format format() const;
+
+        // decode the next 'rows' rows into the top of 'band' (of format() and
+        // at least as wide as the image); false on errors or past the end
+        bool read(QImage & band, int rows);
+
+    protected:
+        ScanlineReader();
+        virtual bool readRows(QImage & band, int rows) = 0;
+        QSize m_size;
+        QImage::Format m_format;
+        int m_row;
+};
+
+#endif
@@ -0,0 +1,94 @@
+/***************************************************************************
+ *                                                                         *
+ *   This file is part of the FotoWall project,                            *
+ *       http://code.google.com/p/fotowall                                 *
+ *                                                                         *
+ *   Copyright (C) 2009 by Enrico Ros <enrico.ros@gmail.com>               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "ThumbnailCache.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#if QT_VERSION >= 0x040500
+#include <QDesktopServices>
+#endif
+
+#define THUMBNAIL_MAX_SIDE 400
+
+// the directory of the thumbnails, looked up once
+class ThumbnailDir
+{
+    public:
+        ThumbnailDir()
+        {
+#if QT_VERSION >= 0x040500
+            path = QDesktopServices::storageLocation(QDesktopServices::CacheLocation);
+#endif
+            if (path.isEmpty())
+                path = QDir::homePath() + "/.fotowall";
+            path += "/thumbnails";
+            QDir().mkpath(path);
+        }
+        QString path;
+};
+Q_GLOBAL_STATIC(ThumbnailDir, s_thumbnailDir)
+
+QImage ThumbnailCache::find(const QString & filePath, QSize * fullSize)
+{
+    const QString path = thumbnailPath(filePath);
+    if (path.isEmpty() || !QFile::exists(path))
+        return QImage();
+    QImage thumbnail(path);
+    if (thumbnail.isNull())
+        return thumbnail;
+
+    // just the header of the original
+    if (fullSize) {
+        *fullSize = QImageReader(filePath).size();
+        if (!fullSize->isValid())
+            *fullSize = thumbnail.size();
+    }
+    return thumbnail;
+}
+
+void ThumbnailCache::store(const QString & filePath, const QImage & image)
+{
+    const QString path = thumbnailPath(filePath);
+    if (path.isEmpty() || image.isNull() || QFile::exists(path))
+        return;
+    QImage thumbnail = image;
+    if (image.width() > THUMBNAIL_MAX_SIDE || image.height() > THUMBNAIL_MAX_SIDE)
+        thumbnail = image.scaled(THUMBNAIL_MAX_SIDE, THUMBNAIL_MAX_SIDE, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+
+    // write aside and rename: readers never see a partial file
+    const QString tempPath = path + ".part";
+    if (thumbnail.save(tempPath, thumbnail.hasAlphaChannel() ? "PNG" : "JPG", 90) && !QFile::rename(tempPath, path))
+        QFile::remove(tempPath);
+}
+
+QString ThumbnailCache::fileKey(const QString & filePath)
+{
+    QFileInfo info(filePath);
+    if (!info.exists())
+        return QString();
+    const QString key = QString("%1|%2|%3").arg(info.absoluteFilePath()).arg(info.lastModified().toTime_t()).arg(info.size());
+    return QString::fromLatin1(QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Md5).toHex());
+}
+
+QString ThumbnailCache::thumbnailPath(const QString & filePath)
+{
+    const QString key = fileKey(filePath);
+    if (key.isEmpty())
+        return QString();
+    return s_thumbnailDir()->path + '/' + key;
+}
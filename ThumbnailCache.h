@@ -0,0 +1,48 @@
+/***************************************************************************
+ *                                                                         *
+ *   This file is part of the FotoWall project,                            *
+ *       http://code.google.com/p/fotowall                                 *
+ *                                                                         *
+ *   Copyright (C) 2009 by Enrico Ros <enrico.ros@gmail.com>               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __ThumbnailCache_h__
+#define __ThumbnailCache_h__
+
+#include <QImage>
+#include <QSize>
+#include <QString>
+
+/**
+    \brief Small copies of the pictures, stored on disk to show them at once
+
+    A thumbnail is keyed by the path, the modification time and the size of
+    its file, so an edited or replaced file just misses. Opening a project
+    paints the thumbnails first, while the real decodes run in background.
+    All the methods are reentrant: thumbnails are stored by the workers.
+*/
+class ThumbnailCache
+{
+    public:
+        // the thumbnail of 'filePath' and the size of the original, or a
+        // null image if missing or out of date
+        static QImage find(const QString & filePath, QSize * fullSize = 0);
+
+        // reduce 'image' (the decoded file) and store it, unless already there
+        static void store(const QString & filePath, const QImage & image);
+
+        // the key of the file contents (path, time and size), empty if missing:
+        // shared by the caches of the pixels of the file
+        static QString fileKey(const QString & filePath);
+
+    private:
+        static QString thumbnailPath(const QString & filePath);
+};
+
+#endif
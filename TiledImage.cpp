@@ -0,0 +1,395 @@
+/***************************************************************************
+ *                                                                         *
+ *   This file is part of the FotoWall project,                            *
+ *       http://code.google.com/p/fotowall                                 *
+ *                                                                         *
+ *   Copyright (C) 2009 by Enrico Ros <enrico.ros@gmail.com>               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "TiledImage.h"
+#include "ImageCache.h"
+#include "RenderSnapshot.h"
+#include "ScanlineReader.h"
+#include "ThumbnailCache.h"
+#include "effects/EffectChain.h"
+#include <QBuffer>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QFuture>
+#include <QHash>
+#include <QImageReader>
+#include <QMap>
+#include <QPainter>
+#include <QSettings>
+#include <QtConcurrentRun>
+#include <math.h>
+#if QT_VERSION >= 0x040500
+#include <QDesktopServices>
+#endif
+
+// files larger than this are tiled instead of decoded at once (64 MPixels)
+#define LARGE_PIXELS (64 * 1024 * 1024)
+
+#define TILE_SIZE 512
+#define TILE_MAGIC 0x46575449   // 'FWTI'
+#define TILE_VERSION 1
+#define DEFAULT_TILE_DIR_MB 2048
+
+// the directory of the tile files, looked up once
+class TileDir
+{
+    public:
+        TileDir()
+        {
+#if QT_VERSION >= 0x040500
+            path = QDesktopServices::storageLocation(QDesktopServices::CacheLocation);
+#endif
+            if (path.isEmpty())
+                path = QDir::homePath() + "/.fotowall";
+            path += "/tiles";
+            QDir().mkpath(path);
+            QSettings s;
+            maxBytes = s.value("fotowall/tileCacheMB", DEFAULT_TILE_DIR_MB).toLongLong() * 1024 * 1024;
+        }
+        QString path;
+        qint64 maxBytes;
+};
+Q_GLOBAL_STATIC(TileDir, s_tileDir)
+
+// the builds running in the thread pool, by tile file (GUI thread only)
+typedef QHash<QString, QFuture<bool> > TileBuilds;
+Q_GLOBAL_STATIC(TileBuilds, s_tileBuilds)
+
+static QString tilePathFor(const QString & filePath)
+{
+    const QString key = ThumbnailCache::fileKey(filePath);
+    return key.isEmpty() ? QString() : s_tileDir()->path + '/' + key;
+}
+
+// a tile decoded by the replay of a snapshot, in any thread
+class TileSource : public RenderSnapshot::Source
+{
+    public:
+        TileSource(const QString & tilePath, qint64 offset, qint64 length, const QList<CEffect> & effects, bool mirrorH, bool mirrorV)
+            : m_tilePath(tilePath)
+            , m_offset(offset)
+            , m_length(length)
+            , m_effects(effects)
+            , m_mirrorH(mirrorH)
+            , m_mirrorV(mirrorV)
+        {
+        }
+
+        QImage load() const
+        {
+            QFile file(m_tilePath);
+            if (!file.open(QIODevice::ReadOnly) || !file.seek(m_offset))
+                return QImage();
+            const QImage pixels = QImage::fromData(file.read(m_length));
+            return EffectChain(m_effects).apply(pixels).mirrored(m_mirrorH, m_mirrorV);
+        }
+
+    private:
+        QString m_tilePath;
+        qint64 m_offset;
+        qint64 m_length;
+        QList<CEffect> m_effects;
+        bool m_mirrorH;
+        bool m_mirrorV;
+};
+
+TiledImage::TiledImage(const QString & filePath)
+    : m_tileSize(0)
+    , m_columns(0)
+    , m_rows(0)
+{
+    const QString tilePath = tilePathFor(filePath);
+    if (tilePath.isEmpty())
+        return;
+    m_cacheGroup = "tiles-" + QFileInfo(tilePath).fileName();
+
+    // split the file the first time, or wait for the split started by prepare()
+    // (only exports and backgrounds draw the tiles: they can wait for it)
+    if (!s_tileBuilds()->contains(tilePath)) {
+        if (open(tilePath))
+            return;
+        QFile::remove(tilePath);
+        prepare(filePath);
+    }
+    if (s_tileBuilds()->contains(tilePath) && s_tileBuilds()->take(tilePath).result())
+        open(tilePath);
+}
+
+void TiledImage::prepare(const QString & filePath)
+{
+    const QString tilePath = tilePathFor(filePath);
+    if (tilePath.isEmpty() || s_tileBuilds()->contains(tilePath) || QFile::exists(tilePath))
+        return;
+
+    // forget the builds done for pictures never drawn by tiles
+    TileBuilds::iterator it = s_tileBuilds()->begin();
+    while (it != s_tileBuilds()->end())
+        it = it.value().isFinished() ? s_tileBuilds()->erase(it) : it + 1;
+    s_tileBuilds()->insert(tilePath, QtConcurrent::run(&TiledImage::build, filePath, tilePath));
+}
+
+bool TiledImage::isLarge(const QSize & fullSize)
+{
+    return (qint64)fullSize.width() * fullSize.height() > LARGE_PIXELS;
+}
+
+bool TiledImage::isNull() const
+{
+    return m_offsets.isEmpty();
+}
+
+QSize TiledImage::size() const
+{
+    return m_size;
+}
+
+bool TiledImage::draw(QPainter * painter, const QRectF & target, const QList<CEffect> & effects)
+{
+    if (isNull() || target.isEmpty())
+        return false;
+
+    // flips become a mirror of the target, the rest runs on each tile
+    bool hFlip = false;
+    bool vFlip = false;
+    QList<CEffect> pixelEffects;
+    foreach (const CEffect & effect, effects) {
+        switch (effect.effect) {
+            case CEffect::ClearEffects:
+                hFlip = vFlip = false;
+                pixelEffects.clear();
+                break;
+            case CEffect::FlipH:
+                hFlip = !hFlip;
+                break;
+            case CEffect::FlipV:
+                vFlip = !vFlip;
+                break;
+            case CEffect::Glow:
+                return false;
+            default:
+                pixelEffects.append(effect);
+                break;
+        }
+    }
+    const EffectChain chain(pixelEffects);
+
+    painter->save();
+    painter->translate(target.center());
+    painter->scale(hFlip ? -1.0 : 1.0, vFlip ? -1.0 : 1.0);
+    painter->translate(-target.center());
+
+    // the painted region, in pixels of the image
+    QRectF visible = painter->worldTransform().inverted().mapRect(QRectF(0, 0, painter->device()->width(), painter->device()->height()));
+    if (painter->hasClipping())
+        visible &= painter->clipRegion().boundingRect();
+    visible &= target;
+    const qreal scaleX = (qreal)m_size.width() / target.width();
+    const qreal scaleY = (qreal)m_size.height() / target.height();
+    const int column0 = qMax(0, (int)floor((visible.left() - target.left()) * scaleX / m_tileSize));
+    const int column1 = qMin(m_columns - 1, (int)floor((visible.right() - target.left()) * scaleX / m_tileSize));
+    const int row0 = qMax(0, (int)floor((visible.top() - target.top()) * scaleY / m_tileSize));
+    const int row1 = qMin(m_rows - 1, (int)floor((visible.bottom() - target.top()) * scaleY / m_tileSize));
+
+    // without rotations, the tile edges are rounded to whole device pixels:
+    // fractional edges would be blended twice (or never) and show as seams
+    const QTransform world = painter->worldTransform();
+    const bool snap = world.type() <= QTransform::TxScale;
+    const bool mirrorH = snap && world.m11() < 0;
+    const bool mirrorV = snap && world.m22() < 0;
+    painter->setRenderHint(QPainter::Antialiasing, false);
+    if (snap)
+        painter->setWorldTransform(QTransform());
+
+    // recording a snapshot: the tiles are read while replaying it
+    const bool recording = dynamic_cast<RenderSnapshot *>(painter->device());
+    for (int row = row0; row <= row1 && !visible.isEmpty(); ++row) {
+        for (int column = column0; column <= column1; ++column) {
+            const int x = column * m_tileSize;
+            const int y = row * m_tileSize;
+            const QRectF dest(target.left() + x / scaleX, target.top() + y / scaleY,
+                              qMin(m_tileSize, m_size.width() - x) / scaleX, qMin(m_tileSize, m_size.height() - y) / scaleY);
+            QRectF drawn = dest;
+            if (snap) {
+                const QRectF device = world.mapRect(dest);
+                drawn = QRect(QPoint(qRound(device.left()), qRound(device.top())),
+                              QPoint(qRound(device.right()) - 1, qRound(device.bottom()) - 1));
+                if (drawn.isEmpty())
+                    continue;
+            }
+            if (recording) {
+                const int index = row * m_columns + column;
+                RenderSnapshot::drawSource(painter, drawn, new TileSource(m_file.fileName(), m_offsets[index],
+                                           m_offsets[index + 1] - m_offsets[index], pixelEffects, mirrorH, mirrorV));
+                continue;
+            }
+            const QImage pixels = chain.apply(tile(column, row));
+            if (!pixels.isNull())
+                painter->drawImage(drawn, pixels.mirrored(mirrorH, mirrorV));
+        }
+    }
+    painter->restore();
+    return true;
+}
+
+bool TiledImage::open(const QString & tilePath)
+{
+    m_file.close();
+    m_file.setFileName(tilePath);
+    if (!m_file.open(QIODevice::ReadOnly))
+        return false;
+    QDataStream in(&m_file);
+    quint32 magic, version;
+    qint32 width, height, tileSize;
+    in >> magic >> version >> width >> height >> tileSize;
+    if (in.status() != QDataStream::Ok || magic != TILE_MAGIC || version != TILE_VERSION || width < 1 || height < 1 || tileSize < 1) {
+        m_file.close();
+        return false;
+    }
+    m_size = QSize(width, height);
+    m_tileSize = tileSize;
+    m_columns = (width + tileSize - 1) / tileSize;
+    m_rows = (height + tileSize - 1) / tileSize;
+    QVector<qint64> offsets(m_columns * m_rows + 1);
+    for (int i = 0; i < offsets.size(); ++i)
+        in >> offsets[i];
+    if (in.status() != QDataStream::Ok || offsets.last() != m_file.size()) {
+        m_file.close();
+        return false;
+    }
+    m_offsets = offsets;
+    return true;
+}
+
+// encode the tiles in the top rows of 'band' (a row of tiles)
+static bool writeTiles(QFile & file, QVector<qint64> & offsets, const QImage & band, int tileRow, int bandHeight)
+{
+    const int columns = (band.width() + TILE_SIZE - 1) / TILE_SIZE;
+    for (int column = 0; column < columns; ++column) {
+        const QImage pixels = band.copy(column * TILE_SIZE, 0, qMin(TILE_SIZE, band.width() - column * TILE_SIZE), bandHeight);
+        QByteArray data;
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::WriteOnly);
+        pixels.save(&buffer, pixels.hasAlphaChannel() ? "PNG" : "JPG", 95);
+        offsets[tileRow * columns + column] = file.pos();
+        if (file.write(data) != data.size())
+            return false;
+    }
+    return true;
+}
+
+bool TiledImage::build(const QString & filePath, const QString & tilePath)
+{
+    // a single pass over the file, a row of tiles at a time. without a
+    // streaming decoder, only the readers that can skip to a clip rect are
+    // used (each band decodes the file up to it: slow, but bounded in memory)
+    ScanlineReader * streamed = ScanlineReader::create(filePath);
+    QSize size = streamed ? streamed->size() : QSize();
+    if (!streamed) {
+        QImageReader reader(filePath);
+        if (!reader.supportsOption(QImageIOHandler::ClipRect))
+            return false;
+        size = reader.size();
+    }
+    if (!size.isValid() || size.isEmpty()) {
+        delete streamed;
+        return false;
+    }
+    const int columns = (size.width() + TILE_SIZE - 1) / TILE_SIZE;
+    const int rows = (size.height() + TILE_SIZE - 1) / TILE_SIZE;
+
+    // header and a placeholder for the offsets, then the tiles
+    const QString partPath = tilePath + ".part";
+    QFile file(partPath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        delete streamed;
+        return false;
+    }
+    QDataStream out(&file);
+    out << (quint32)TILE_MAGIC << (quint32)TILE_VERSION << (qint32)size.width() << (qint32)size.height() << (qint32)TILE_SIZE;
+    const qint64 indexPos = file.pos();
+    QVector<qint64> offsets(columns * rows + 1);
+    for (int i = 0; i < offsets.size(); ++i)
+        out << offsets[i];
+
+    bool ok = true;
+    QImage band;
+    if (streamed)
+        band = QImage(size.width(), TILE_SIZE, streamed->format());
+    for (int row = 0; row < rows && ok; ++row) {
+        const int bandHeight = qMin(TILE_SIZE, size.height() - row * TILE_SIZE);
+        if (streamed)
+            ok = streamed->read(band, bandHeight);
+        else {
+            QImageReader reader(filePath);
+            reader.setClipRect(QRect(0, row * TILE_SIZE, size.width(), bandHeight));
+            band = reader.read();
+            ok = band.width() == size.width() && band.height() == bandHeight;
+        }
+        ok = ok && writeTiles(file, offsets, band, row, bandHeight);
+    }
+    delete streamed;
+    offsets.last() = file.pos();
+    if (ok) {
+        file.seek(indexPos);
+        for (int i = 0; i < offsets.size(); ++i)
+            out << offsets[i];
+        ok = out.status() == QDataStream::Ok;
+    }
+    file.close();
+    if (!ok || !QFile::rename(partPath, tilePath)) {
+        QFile::remove(partPath);
+        return false;
+    }
+    trimTileDir(tilePath);
+    return true;
+}
+
+void TiledImage::trimTileDir(const QString & keepPath)
+{
+    // the least recently used tile files go first
+    const QFileInfoList files = QDir(s_tileDir()->path).entryInfoList(QDir::Files);
+    QMultiMap<QDateTime, QFileInfo> byUse;
+    qint64 total = 0;
+    foreach (const QFileInfo & info, files) {
+        if (info.suffix() == "part")
+            continue;
+        total += info.size();
+        if (info.absoluteFilePath() != QFileInfo(keepPath).absoluteFilePath())
+            byUse.insert(qMax(info.lastRead(), info.lastModified()), info);
+    }
+    QMultiMap<QDateTime, QFileInfo>::const_iterator it = byUse.constBegin();
+    for (; total > s_tileDir()->maxBytes && it != byUse.constEnd(); ++it)
+        if (QFile::remove(it.value().absoluteFilePath()))
+            total -= it.value().size();
+}
+
+QImage TiledImage::tile(int column, int row)
+{
+    // decoded tiles are shared by all the pictures of the file
+    ImageCache * cache = ImageCache::instance();
+    const QString key = QString("%1/%2,%3").arg(m_cacheGroup).arg(column).arg(row);
+    QImage pixels = cache->find(key);
+    if (pixels.isNull()) {
+        const int index = row * m_columns + column;
+        if (!m_file.seek(m_offsets[index]))
+            return QImage();
+        const QByteArray data = m_file.read(m_offsets[index + 1] - m_offsets[index]);
+        pixels = QImage::fromData(data);
+        cache->insert(key, pixels);
+    }
+    return pixels;
+}
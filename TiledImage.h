@@ -0,0 +1,73 @@
+/***************************************************************************
+ *                                                                         *
+ *   This file is part of the FotoWall project,                            *
+ *       http://code.google.com/p/fotowall                                 *
+ *                                                                         *
+ *   Copyright (C) 2009 by Enrico Ros <enrico.ros@gmail.com>               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __TiledImage_h__
+#define __TiledImage_h__
+
+#include <QFile>
+#include <QImage>
+#include <QList>
+#include <QRectF>
+#include <QSize>
+#include <QString>
+#include <QVector>
+#include "effects/Effect.h"
+class QPainter;
+
+/**
+    \brief Pixels of a very large file, in tiles read on demand
+
+    The first use of a file splits it in fixed-size tiles, compressed into a
+    tile file in the user cache directory (keyed as the thumbnails: path,
+    modification time and size). The split runs in a worker thread, in a
+    single pass of the ScanlineReader over the file, so the whole image is
+    never in memory; the tile directory is capped by the setting
+    "fotowall/tileCacheMB". Drawing then reads just the tiles that fall in
+    the painted region; the decoded tiles live in the ImageCache.
+    Use it from the GUI thread only.
+*/
+class TiledImage
+{
+    public:
+        TiledImage(const QString & filePath);
+
+        // true if the file is too large to be decoded as a whole
+        static bool isLarge(const QSize & fullSize);
+
+        // start splitting the file in the background, if not done yet
+        static void prepare(const QString & filePath);
+
+        bool isNull() const;
+        QSize size() const;
+
+        // draw the tiles intersecting the painter's visible region into
+        // 'target', with 'effects'; false if they aren't local to pixels
+        bool draw(QPainter * painter, const QRectF & target, const QList<CEffect> & effects);
+
+    private:
+        bool open(const QString & tilePath);
+        static bool build(const QString & filePath, const QString & tilePath);
+        static void trimTileDir(const QString & keepPath);
+        QImage tile(int column, int row);
+
+        QFile m_file;
+        QString m_cacheGroup;
+        QSize m_size;
+        int m_tileSize;
+        int m_columns;
+        int m_rows;
+        QVector<qint64> m_offsets;  // one more than the tiles: the end
+};
+
+#endif
@@ -26,6 +26,7 @@
 #include "CPixmap.h"
 #include "Desk.h"
 #include "FotoWall.h"
+#include "PictureLoader.h"
 #include <QFile>
 #include <QGraphicsView>
 #include <QMessageBox>
@@ -144,6 +145,12 @@ void XmlRead::readContent(Desk * desk)
         if (!content->fromXml(element)) {
             desk->m_content.removeAll(content);
             delete content;
+            continue;
         }
+
+        // pictures shown from their thumbnails get decoded in background
+        PictureContent * picture = dynamic_cast<PictureContent *>(content);
+        if (picture && picture->hasPreviewPhoto())
+            desk->m_pictureLoader->load(picture, picture->filePath());
     }
 }
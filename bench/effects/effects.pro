@@ -0,0 +1,19 @@
+# Effects benchmark: times every CEffect through EffectChain (the same path
+# used by CPixmap) on synthetic or loaded images. Build it on its own:
+#   cd bench/effects && qmake && make && ./effects-bench --help
+TEMPLATE = app
+TARGET = effects-bench
+CONFIG += console release
+CONFIG -= app_bundle
+DEPENDPATH += .
+INCLUDEPATH += ../../effects
+MOC_DIR = .build
+OBJECTS_DIR = .build
+QT = core \
+    gui
+
+# Input
+SOURCES += main.cpp
+
+# Sub-Components
+include(../../effects/effects.pri)
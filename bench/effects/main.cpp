@@ -0,0 +1,264 @@
+/***************************************************************************
+ *                                                                         *
+ *   This file is part of the FotoWall project,                            *
+ *       http://code.google.com/p/fotowall                                 *
+ *                                                                         *
+ *   Copyright (C) 2009 by Enrico Ros <enrico.ros@gmail.com>               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "ColorKernels.h"
+#include "Effect.h"
+#include "EffectChain.h"
+#include <QCoreApplication>
+#include <QFile>
+#include <QImage>
+#include <QStringList>
+#include <QTime>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(__GLIBC__)
+#include <sys/resource.h>
+#define HAS_MALLOC_COUNT
+
+// count every allocation of the process (operator new ends up here too)
+extern "C" void * __libc_malloc(size_t size);
+extern "C" void * __libc_calloc(size_t count, size_t size);
+extern "C" void * __libc_realloc(void * ptr, size_t size);
+static volatile long s_allocCount = 0;
+static volatile long long s_allocBytes = 0;
+
+extern "C" void * malloc(size_t size) throw()
+{
+    __sync_fetch_and_add(&s_allocCount, 1);
+    __sync_fetch_and_add(&s_allocBytes, (long long)size);
+    return __libc_malloc(size);
+}
+
+extern "C" void * calloc(size_t count, size_t size) throw()
+{
+    __sync_fetch_and_add(&s_allocCount, 1);
+    __sync_fetch_and_add(&s_allocBytes, (long long)(count * size));
+    return __libc_calloc(count, size);
+}
+
+extern "C" void * realloc(void * ptr, size_t size) throw()
+{
+    __sync_fetch_and_add(&s_allocCount, 1);
+    __sync_fetch_and_add(&s_allocBytes, (long long)size);
+    return __libc_realloc(ptr, size);
+}
+#endif
+
+struct BenchCase {
+    QString name;
+    CEffect effect;
+};
+
+static QList<BenchCase> benchCases(const QList<int> & glowRadii)
+{
+    QList<BenchCase> cases;
+    BenchCase c;
+    c.name = "flip-h";          c.effect = CEffect(CEffect::FlipH);         cases.append(c);
+    c.name = "flip-v";          c.effect = CEffect(CEffect::FlipV);         cases.append(c);
+    c.name = "invert";          c.effect = CEffect(CEffect::InvertColors);  cases.append(c);
+    c.name = "nvg";             c.effect = CEffect(CEffect::NVG);           cases.append(c);
+    c.name = "black-and-white"; c.effect = CEffect(CEffect::BlackAndWhite); cases.append(c);
+    c.name = "sepia";           c.effect = CEffect(CEffect::Sepia);         cases.append(c);
+    c.name = "brightness";      c.effect = CEffect(CEffect::Brightness, 30); cases.append(c);
+    c.name = "contrast";        c.effect = CEffect(CEffect::Contrast, 20);  cases.append(c);
+    c.name = "gamma";           c.effect = CEffect(CEffect::Gamma, 1.5);    cases.append(c);
+    foreach (int radius, glowRadii) {
+        c.name = QString("glow-%1").arg(radius);
+        c.effect = CEffect(CEffect::Glow, radius);
+        cases.append(c);
+    }
+    return cases;
+}
+
+// a photo-like image: smooth gradients, some edges and noise, opaque
+static QImage syntheticImage(int width, int height)
+{
+    QImage image(width, height, QImage::Format_RGB32);
+    quint32 noise = 0x12345678;
+    for (int y = 0; y < height; ++y) {
+        QRgb * line = (QRgb *)image.scanLine(y);
+        for (int x = 0; x < width; ++x) {
+            noise = noise * 1664525 + 1013904223;
+            const int n = (noise >> 24) & 0x1f;
+            const int block = ((x / 64) + (y / 64)) & 1 ? 40 : 0;
+            line[x] = qRgb(qMin(255, (x * 200) / width + block + n),
+                           qMin(255, (y * 200) / height + n),
+                           qMin(255, ((x + y) * 100) / (width + height) + block + n));
+        }
+    }
+    return image;
+}
+
+// 4:3 size of about 'megaPixels'
+static QSize sizeForMegaPixels(int megaPixels)
+{
+    const qreal unit = sqrt(megaPixels * 1000000.0 / 12.0);
+    return QSize(qRound(unit * 4), qRound(unit * 3));
+}
+
+#if defined(Q_OS_LINUX)
+// restart the 'peak RSS' (VmHWM) accounting of the process
+static bool resetPeakRss()
+{
+    QFile clearRefs("/proc/self/clear_refs");
+    if (!clearRefs.open(QIODevice::WriteOnly))
+        return false;
+    return clearRefs.write("5") == 1;
+}
+
+static qint64 peakRssKB()
+{
+    QFile status("/proc/self/status");
+    if (status.open(QIODevice::ReadOnly)) {
+        foreach (const QByteArray & line, status.readAll().split('\n'))
+            if (line.startsWith("VmHWM:"))
+                return line.mid(6).trimmed().split(' ').first().toLongLong();
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+#else
+static bool resetPeakRss()
+{
+    return false;
+}
+
+static qint64 peakRssKB()
+{
+    return -1;
+}
+#endif
+
+static void usage()
+{
+    fprintf(stderr,
+        "usage: effects-bench [options]\n"
+        "  -s, --sizes LIST     megapixels of the test images (default: 1,12,24,50)\n"
+        "  -i, --image FILE     scale this image instead of generating one\n"
+        "  -g, --glow LIST      glow radii (default: 5,10,20,50)\n"
+        "  -e, --effect NAME    run only the effects whose name starts with NAME\n"
+        "  -r, --repeat N       calls per effect, the best is reported (default: 3)\n"
+        "      --isa NAME       scalar, sse2 or avx2 (default: the detected one)\n"
+        "output: one tab separated line per effect and size, after a '#' header\n");
+}
+
+static QList<int> intList(const QString & text)
+{
+    QList<int> values;
+    foreach (const QString & value, text.split(',', QString::SkipEmptyParts))
+        values.append(value.toInt());
+    return values;
+}
+
+int main(int argc, char ** argv)
+{
+    QCoreApplication app(argc, argv);
+
+    // parse the command line
+    QList<int> sizes = intList("1,12,24,50");
+    QList<int> glowRadii = intList("5,10,20,50");
+    QString imageFile, effectFilter;
+    int repeat = 3;
+    QStringList args = app.arguments().mid(1);
+    while (!args.isEmpty()) {
+        const QString arg = args.takeFirst();
+        if (arg == "-h" || arg == "--help") {
+            usage();
+            return 0;
+        }
+        if (args.isEmpty()) {
+            usage();
+            return 1;
+        }
+        const QString value = args.takeFirst();
+        if (arg == "-s" || arg == "--sizes")
+            sizes = intList(value);
+        else if (arg == "-i" || arg == "--image")
+            imageFile = value;
+        else if (arg == "-g" || arg == "--glow")
+            glowRadii = intList(value);
+        else if (arg == "-e" || arg == "--effect")
+            effectFilter = value;
+        else if (arg == "-r" || arg == "--repeat")
+            repeat = qMax(1, value.toInt());
+        else if (arg == "--isa")
+            ColorKernels::setIsa(value == "scalar" ? ColorKernels::IsaScalar : value == "sse2" ? ColorKernels::IsaSSE2 : ColorKernels::IsaAVX2);
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    QImage sourceImage;
+    if (!imageFile.isEmpty() && !sourceImage.load(imageFile)) {
+        fprintf(stderr, "effects-bench: can't load '%s'\n", qPrintable(imageFile));
+        return 1;
+    }
+
+    printf("# isa=%s malloc_count=%d peak_rss=%d\n", ColorKernels::isaName(ColorKernels::isa()),
+#if defined(HAS_MALLOC_COUNT)
+           1,
+#else
+           0,
+#endif
+           resetPeakRss() ? 1 : 0);
+    printf("#effect\tmpix\twidth\theight\tbest_ms\tmpix_per_s\tpeak_rss_kb\tallocs_per_call\talloc_mb_per_call\n");
+    fflush(stdout);
+
+    const QList<BenchCase> cases = benchCases(glowRadii);
+    foreach (int megaPixels, sizes) {
+        const QSize size = sizeForMegaPixels(megaPixels);
+        const QImage image = sourceImage.isNull() ? syntheticImage(size.width(), size.height())
+            : sourceImage.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation).convertToFormat(QImage::Format_RGB32);
+
+        foreach (const BenchCase & c, cases) {
+            if (!effectFilter.isEmpty() && !c.name.startsWith(effectFilter))
+                continue;
+
+            // the same path of CPixmap: compile the chain, run it on the image
+            QList<CEffect> effects;
+            effects.append(c.effect);
+            int bestMs = -1;
+            long allocs = 0;
+            long long allocBytes = 0;
+            resetPeakRss();
+            for (int i = 0; i < repeat; ++i) {
+#if defined(HAS_MALLOC_COUNT)
+                const long allocsBefore = s_allocCount;
+                const long long bytesBefore = s_allocBytes;
+#endif
+                QTime time;
+                time.start();
+                QImage result = EffectChain(effects).apply(image);
+                const int ms = time.elapsed();
+#if defined(HAS_MALLOC_COUNT)
+                allocs = s_allocCount - allocsBefore;
+                allocBytes = s_allocBytes - bytesBefore;
+#endif
+                if (bestMs < 0 || ms < bestMs)
+                    bestMs = ms;
+            }
+
+            const qreal mpix = (qreal)image.width() * image.height() / 1000000.0;
+            printf("%s\t%.2f\t%d\t%d\t%d\t%.1f\t%lld\t%ld\t%.2f\n", qPrintable(c.name), mpix,
+                   image.width(), image.height(), bestMs, bestMs > 0 ? mpix * 1000.0 / bestMs : 0.0,
+                   (long long)peakRssKB(), allocs, allocBytes / (1024.0 * 1024.0));
+            fflush(stdout);
+        }
+    }
+    return 0;
+}
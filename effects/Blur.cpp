@@ -0,0 +1,250 @@
+/****************************************************************************
+**
+** Copyright (C) 2007-2007 Trolltech ASA. All rights reserved.
+**
+** This file is part of the Graphics Dojo project on Trolltech Labs.
+**
+** This file may be used under the terms of the GNU General Public
+** License version 2.0 as published by the Free Software Foundation
+** and appearing in the file LICENSE.GPL included in the packaging of
+** this file.  Please review the following information to ensure GNU
+** General Public Licensing requirements will be met:
+** http://www.trolltech.com/products/qt/opensource.html
+**
+** If you are unsure which license is appropriate for your use, please
+** review the following information:
+** http://www.trolltech.com/products/qt/licensing.html or contact the
+** sales department at sales@trolltech.com.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+****************************************************************************/
+#include "Blur.h"
+#include "ColorKernels.h"
+
+#include <QPainter>
+#include <QThread>
+#include <QVector>
+#include <QtConcurrentMap>
+
+#include <cmath>
+
+// Exponential blur, Jani Huhtanen, 2006
+//
+// The rows and the columns are blurred in parallel: the rows split in bands,
+// the columns in blocks of COLUMN_BLOCK adjacent pixels walked down together,
+// so that each step reads and writes whole cache lines instead of striding a
+// full scanline per pixel. Every pixel sees the very same recurrence as in
+// the original row-by-row, column-by-column version: the output is identical.
+#define COLUMN_BLOCK 16         // 16 pixels = one 64 bytes cache line
+#define MIN_SPAN_PIXELS 65536   // don't hand out smaller pieces of work
+
+template<int aprec, int zprec>
+static inline void blurinner(unsigned char *bptr, int &zR, int &zG, int &zB, int &zA, int alpha);
+
+template<int aprec,int zprec>
+static inline void blurrow( unsigned char *ptr, int width, int alpha);
+
+template<int aprec, int zprec>
+static inline void blurcolumns( unsigned char *ptr, int count, int height, int bpl, int alpha);
+
+// a band of rows or a range of columns of the image
+struct BlurSpan {
+  unsigned char *bits;
+  int width, height, bpl;
+  int first, count;
+  bool columns;
+  int alpha;
+};
+
+template<int aprec,int zprec>
+static void blurspan( const BlurSpan &span )
+{
+  if(!span.columns)
+  {
+    for(int row=span.first;row<span.first+span.count;row++)
+      blurrow<aprec,zprec>(span.bits+(qint64)row*span.bpl,span.width,span.alpha);
+    return;
+  }
+  for(int col=span.first;col<span.first+span.count;col+=COLUMN_BLOCK)
+    blurcolumns<aprec,zprec>(span.bits+col*4,qMin(COLUMN_BLOCK,span.first+span.count-col),span.height,span.bpl,span.alpha);
+}
+
+// split 'total' rows or columns in pieces, multiple of 'granularity'
+static QList<BlurSpan> blurspans( const BlurSpan &whole, int total, int granularity )
+{
+  const int lineLength = whole.columns ? whole.height : whole.width;
+  int pieces = qMin(QThread::idealThreadCount() * 4, (int)(((qint64)total * lineLength) / MIN_SPAN_PIXELS));
+  pieces = qMax(1, pieces);
+  int step = (total + pieces - 1) / pieces;
+  step = ((step + granularity - 1) / granularity) * granularity;
+
+  QList<BlurSpan> spans;
+  for(int first=0;first<total;first+=step)
+  {
+    BlurSpan span = whole;
+    span.first = first;
+    span.count = qMin(step, total - first);
+    spans.append(span);
+  }
+  return spans;
+}
+
+/*
+*  expblur(QImage &img, int radius)
+*
+*  In-place blur of image 'img' with kernel
+*  of approximate radius 'radius'.
+*
+*  Blurs with two sided exponential impulse
+*  response.
+*
+*  aprec = precision of alpha parameter
+*  in fixed-point format 0.aprec
+*
+*  zprec = precision of state parameters
+*  zR,zG,zB and zA in fp format 8.zprec
+*/
+template<int aprec,int zprec>
+static void expblur( QImage &img, int radius )
+{
+  if(radius<1 || img.isNull())
+    return;
+
+  /* Calculate the alpha such that 90% of
+     the kernel is within the radius.
+     (Kernel extends to infinity)
+  */
+  int alpha = (int)((1<<aprec)*(1.0f-expf(-2.3f/(radius+1.f))));
+
+  // detach once here: the workers only see the raw pixels
+  BlurSpan whole;
+  whole.bits = img.bits();
+  whole.width = img.width();
+  whole.height = img.height();
+  whole.bpl = img.bytesPerLine();
+  whole.first = 0;
+  whole.count = 0;
+  whole.columns = false;
+  whole.alpha = alpha;
+
+  QList<BlurSpan> rows = blurspans(whole, whole.height, 1);
+  QtConcurrent::blockingMap(rows, &blurspan<aprec,zprec>);
+
+  whole.columns = true;
+  QList<BlurSpan> columns = blurspans(whole, whole.width, COLUMN_BLOCK);
+  QtConcurrent::blockingMap(columns, &blurspan<aprec,zprec>);
+}
+
+template<int aprec, int zprec>
+static inline void blurinner(unsigned char *bptr, int &zR, int &zG, int &zB, int &zA, int alpha)
+{
+  int R,G,B,A;
+  R = *bptr;
+  G = *(bptr+1);
+  B = *(bptr+2);
+  A = *(bptr+3);
+
+  zR += (alpha * ((R<<zprec)-zR))>>aprec;
+  zG += (alpha * ((G<<zprec)-zG))>>aprec;
+  zB += (alpha * ((B<<zprec)-zB))>>aprec;
+  zA += (alpha * ((A<<zprec)-zA))>>aprec;
+
+  *bptr =     zR>>zprec;
+  *(bptr+1) = zG>>zprec;
+  *(bptr+2) = zB>>zprec;
+  *(bptr+3) = zA>>zprec;
+}
+
+template<int aprec,int zprec>
+static inline void blurrow( unsigned char *ptr, int width, int alpha)
+{
+  int zR,zG,zB,zA;
+
+  zR = *(ptr    )<<zprec;
+  zG = *(ptr + 1)<<zprec;
+  zB = *(ptr + 2)<<zprec;
+  zA = *(ptr + 3)<<zprec;
+
+  for(int index=1; index<width; index++)
+  {
+    blurinner<aprec,zprec>(ptr+index*4,zR,zG,zB,zA,alpha);
+  }
+  for(int index=width-2; index>=0; index--)
+  {
+    blurinner<aprec,zprec>(ptr+index*4,zR,zG,zB,zA,alpha);
+  }
+}
+
+// 'bytes' / 4 adjacent columns, starting at 'ptr' on the first row.
+// the state of every channel of the block is independent: the loops over the
+// block bytes have no dependencies and the compiler can vectorize them
+template<int aprec, int zprec, int bytes>
+static inline void blurcolumnbytes( unsigned char *ptr, int height, int bpl, int alpha)
+{
+  int z[bytes];
+
+  for(int i=0; i<bytes; i++)
+    z[i] = ptr[i]<<zprec;
+
+  // as the original: down to the row before the last, then back to the first
+  for(int row=1; row<height-1; row++)
+  {
+    unsigned char *line = ptr + (qint64)row*bpl;
+    for(int i=0; i<bytes; i++)
+    {
+      z[i] += (alpha * ((line[i]<<zprec)-z[i]))>>aprec;
+      line[i] = z[i]>>zprec;
+    }
+  }
+
+  for(int row=height-2; row>=0; row--)
+  {
+    unsigned char *line = ptr + (qint64)row*bpl;
+    for(int i=0; i<bytes; i++)
+    {
+      z[i] += (alpha * ((line[i]<<zprec)-z[i]))>>aprec;
+      line[i] = z[i]>>zprec;
+    }
+  }
+}
+
+// 'count' (<= COLUMN_BLOCK) adjacent columns: full blocks get a constant trip
+// count, the last narrow block goes one column at a time
+template<int aprec, int zprec>
+static inline void blurcolumns( unsigned char *ptr, int count, int height, int bpl, int alpha)
+{
+  if(count==COLUMN_BLOCK)
+  {
+    blurcolumnbytes<aprec,zprec,COLUMN_BLOCK*4>(ptr,height,bpl,alpha);
+    return;
+  }
+  for(int c=0; c<count; c++)
+    blurcolumnbytes<aprec,zprec,4>(ptr+c*4,height,bpl,alpha);
+}
+
+void Blur::expBlur(QImage & image, int radius)
+{
+    image = ColorKernels::to32bpp(image);
+    //ExpBlur with 0.16 fp for alpha and
+    //8.7 fp for state parameters zR,zG,zB and zA
+    expblur<16,7>(image, radius);
+}
+
+QImage Blur::glow(const QImage & image, int radius)
+{
+    QImage back(image.size(), QImage::Format_ARGB32_Premultiplied);
+    back.fill(0x00);
+    QPainter p(&back);
+    p.drawImage(0, 0, image);
+
+    QImage blurred = image;
+    expBlur(blurred, radius);
+
+    p.setCompositionMode(QPainter::CompositionMode_Plus);
+    p.drawImage(0, 0, blurred);
+    p.end();
+
+    return back;
+}
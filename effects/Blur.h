@@ -0,0 +1,44 @@
+/****************************************************************************
+**
+** Copyright (C) 2007-2007 Trolltech ASA. All rights reserved.
+**
+** This file is part of the Graphics Dojo project on Trolltech Labs.
+**
+** This file may be used under the terms of the GNU General Public
+** License version 2.0 as published by the Free Software Foundation
+** and appearing in the file LICENSE.GPL included in the packaging of
+** this file.  Please review the following information to ensure GNU
+** General Public Licensing requirements will be met:
+** http://www.trolltech.com/products/qt/opensource.html
+**
+** If you are unsure which license is appropriate for your use, please
+** review the following information:
+** http://www.trolltech.com/products/qt/licensing.html or contact the
+** sales department at sales@trolltech.com.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+****************************************************************************/
+
+#ifndef __Blur_h__
+#define __Blur_h__
+
+#include <QImage>
+
+/**
+    \brief Blurs and glow over QImages, with no widget dependencies
+
+    Everything here is reentrant: it can run in any thread, on different
+    images at the same time. Non 32bpp images are converted first.
+*/
+namespace Blur
+{
+    // in-place blur with a two sided exponential impulse response
+    void expBlur(QImage & image, int radius);
+
+    // the image plus its blurred copy ('plus' composited)
+    QImage glow(const QImage & image, int radius);
+}
+
+#endif
@@ -0,0 +1,454 @@
+/***************************************************************************
+ *                                                                         *
+ *   This file is part of the FotoWall project,                            *
+ *       http://code.google.com/p/fotowall                                 *
+ *                                                                         *
+ *   Copyright (C) 2009 by Enrico Ros <enrico.ros@gmail.com>               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "ColorKernels.h"
+
+// SIMD paths are only compiled on x86 with compilers that can target an
+// instruction set per-function (so the rest of the program stays generic)
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#  if defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#    define FW_X86_SIMD
+#    define FW_TARGET(isa) __attribute__((target(isa)))
+#    include <cpuid.h>
+#    include <immintrin.h>
+#  elif defined(_MSC_VER) && _MSC_VER >= 1700
+#    define FW_X86_SIMD
+#    define FW_TARGET(isa)
+#    include <intrin.h>
+#    include <immintrin.h>
+#  endif
+#endif
+
+using namespace ColorKernels;
+
+/// Instruction set detection
+#if defined(FW_X86_SIMD)
+static void cpuid(unsigned leaf, unsigned subLeaf, unsigned regs[4])
+{
+#if defined(_MSC_VER)
+    int r[4];
+    __cpuidex(r, (int)leaf, (int)subLeaf);
+    for (int i = 0; i < 4; ++i)
+        regs[i] = (unsigned)r[i];
+#else
+    __cpuid_count(leaf, subLeaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static quint64 xgetbv0()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    unsigned eax, edx;
+    __asm__ __volatile__("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+    return ((quint64)edx << 32) | eax;
+#endif
+}
+#endif
+
+static Isa probeIsa()
+{
+#if defined(FW_X86_SIMD)
+    unsigned regs[4];
+    cpuid(0, 0, regs);
+    const unsigned maxLeaf = regs[0];
+    if (maxLeaf < 1)
+        return IsaScalar;
+
+    // SSE2: edx bit 26
+    cpuid(1, 0, regs);
+    if (!(regs[3] & (1u << 26)))
+        return IsaScalar;
+
+    // AVX2: needs OSXSAVE + AVX, the OS saving YMM state and leaf 7 ebx bit 5
+    const bool osxsave = regs[2] & (1u << 27);
+    const bool avx = regs[2] & (1u << 28);
+    if (osxsave && avx && maxLeaf >= 7 && (xgetbv0() & 0x6) == 0x6) {
+        cpuid(7, 0, regs);
+        if (regs[1] & (1u << 5))
+            return IsaAVX2;
+    }
+    return IsaSSE2;
+#else
+    return IsaScalar;
+#endif
+}
+
+struct IsaState {
+    IsaState() : detected(probeIsa()), current(detected) {}
+    Isa detected;
+    Isa current;
+};
+Q_GLOBAL_STATIC(IsaState, s_isa)
+
+Isa ColorKernels::detectedIsa()
+{
+    return s_isa()->detected;
+}
+
+Isa ColorKernels::isa()
+{
+    return s_isa()->current;
+}
+
+void ColorKernels::setIsa(Isa isa)
+{
+    s_isa()->current = qMin(isa, s_isa()->detected);
+}
+
+const char * ColorKernels::isaName(Isa isa)
+{
+    switch (isa) {
+        case IsaAVX2: return "avx2";
+        case IsaSSE2: return "sse2";
+        default: return "scalar";
+    }
+}
+
+
+/// Scalar kernels (the reference results)
+static inline uint rgbSum(QRgb p)
+{
+    return qRed(p) + qGreen(p) + qBlue(p);
+}
+
+static inline QRgb grayPixel(uint level)
+{
+    return 0xff000000 | (level << 16) | (level << 8) | level;
+}
+
+static void grayRow_scalar(const QRgb * src, QRgb * dst, int count)
+{
+    for (int i = 0; i < count; ++i)
+        dst[i] = grayPixel(rgbSum(src[i]) / 3);
+}
+
+static void blackAndWhiteRow_scalar(const QRgb * src, QRgb * dst, int count)
+{
+    for (int i = 0; i < count; ++i)
+        dst[i] = grayPixel(rgbSum(src[i]) / 3 > 127 ? 255 : 0);
+}
+
+static void sumLookupRow_scalar(const QRgb * src, QRgb * dst, int count, const QRgb * table)
+{
+    for (int i = 0; i < count; ++i)
+        dst[i] = table[rgbSum(src[i])];
+}
+
+static void channelLookupRow_scalar(const QRgb * src, QRgb * dst, int count, const quint32 * luts)
+{
+    for (int i = 0; i < count; ++i) {
+        const QRgb p = src[i];
+        dst[i] = (p & 0xff000000) | (luts[qRed(p)] << 16) | (luts[256 + qGreen(p)] << 8) | luts[512 + qBlue(p)];
+    }
+}
+
+static void channelSumLookupRow_scalar(const QRgb * src, QRgb * dst, int count, const quint32 * luts, const QRgb * table)
+{
+    for (int i = 0; i < count; ++i) {
+        const QRgb p = src[i];
+        dst[i] = table[luts[qRed(p)] + luts[256 + qGreen(p)] + luts[512 + qBlue(p)]];
+    }
+}
+
+
+/// SSE2 kernels (8 pixels per step)
+// NOTE: 'sum / 3' is computed as '(sum * 0xAAAB) >> 17', exact for sum <= 765
+#if defined(FW_X86_SIMD)
+FW_TARGET("sse2") static inline __m128i sums_sse2(__m128i p)
+{
+    const __m128i mask = _mm_set1_epi32(0xff);
+    const __m128i b = _mm_and_si128(p, mask);
+    const __m128i g = _mm_and_si128(_mm_srli_epi32(p, 8), mask);
+    const __m128i r = _mm_and_si128(_mm_srli_epi32(p, 16), mask);
+    return _mm_add_epi32(_mm_add_epi32(r, g), b);
+}
+
+FW_TARGET("sse2") static inline __m128i averages_sse2(const QRgb * src)
+{
+    const __m128i lo = sums_sse2(_mm_loadu_si128((const __m128i *)src));
+    const __m128i hi = sums_sse2(_mm_loadu_si128((const __m128i *)(src + 4)));
+    const __m128i sums = _mm_packs_epi32(lo, hi);
+    return _mm_srli_epi16(_mm_mulhi_epu16(sums, _mm_set1_epi16((short)0xAAAB)), 1);
+}
+
+FW_TARGET("sse2") static inline __m128i grayPixels_sse2(__m128i level)
+{
+    const __m128i alpha = _mm_set1_epi32((int)0xff000000);
+    return _mm_or_si128(_mm_or_si128(level, _mm_slli_epi32(level, 8)),
+                        _mm_or_si128(_mm_slli_epi32(level, 16), alpha));
+}
+
+FW_TARGET("sse2") static void grayRow_sse2(const QRgb * src, QRgb * dst, int count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m128i avg = averages_sse2(src + i);
+        _mm_storeu_si128((__m128i *)(dst + i), grayPixels_sse2(_mm_unpacklo_epi16(avg, zero)));
+        _mm_storeu_si128((__m128i *)(dst + i + 4), grayPixels_sse2(_mm_unpackhi_epi16(avg, zero)));
+    }
+    grayRow_scalar(src + i, dst + i, count - i);
+}
+
+FW_TARGET("sse2") static void blackAndWhiteRow_sse2(const QRgb * src, QRgb * dst, int count)
+{
+    const __m128i threshold = _mm_set1_epi16(127);
+    const __m128i rgbMask = _mm_set1_epi32(0x00ffffff);
+    const __m128i alpha = _mm_set1_epi32((int)0xff000000);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m128i white = _mm_cmpgt_epi16(averages_sse2(src + i), threshold);
+        const __m128i lo = _mm_unpacklo_epi16(white, white);
+        const __m128i hi = _mm_unpackhi_epi16(white, white);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(_mm_and_si128(lo, rgbMask), alpha));
+        _mm_storeu_si128((__m128i *)(dst + i + 4), _mm_or_si128(_mm_and_si128(hi, rgbMask), alpha));
+    }
+    blackAndWhiteRow_scalar(src + i, dst + i, count - i);
+}
+
+FW_TARGET("sse2") static void sumLookupRow_sse2(const QRgb * src, QRgb * dst, int count, const QRgb * table)
+{
+    // SSE2 has no gather: vector sums, scalar lookups
+    quint16 sums[8];
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m128i lo = sums_sse2(_mm_loadu_si128((const __m128i *)(src + i)));
+        const __m128i hi = sums_sse2(_mm_loadu_si128((const __m128i *)(src + i + 4)));
+        _mm_storeu_si128((__m128i *)sums, _mm_packs_epi32(lo, hi));
+        for (int j = 0; j < 8; ++j)
+            dst[i + j] = table[sums[j]];
+    }
+    sumLookupRow_scalar(src + i, dst + i, count - i, table);
+}
+
+
+/// AVX2 kernels (8 pixels per step, with gathers)
+FW_TARGET("avx2") static inline __m256i sums_avx2(const QRgb * src)
+{
+    const __m256i p = _mm256_loadu_si256((const __m256i *)src);
+    const __m256i mask = _mm256_set1_epi32(0xff);
+    const __m256i b = _mm256_and_si256(p, mask);
+    const __m256i g = _mm256_and_si256(_mm256_srli_epi32(p, 8), mask);
+    const __m256i r = _mm256_and_si256(_mm256_srli_epi32(p, 16), mask);
+    return _mm256_add_epi32(_mm256_add_epi32(r, g), b);
+}
+
+FW_TARGET("avx2") static inline __m256i averages_avx2(const QRgb * src)
+{
+    return _mm256_srli_epi32(_mm256_mullo_epi32(sums_avx2(src), _mm256_set1_epi32(0xAAAB)), 17);
+}
+
+FW_TARGET("avx2") static void grayRow_avx2(const QRgb * src, QRgb * dst, int count)
+{
+    const __m256i alpha = _mm256_set1_epi32((int)0xff000000);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i level = averages_avx2(src + i);
+        const __m256i pixels = _mm256_or_si256(_mm256_or_si256(level, _mm256_slli_epi32(level, 8)),
+                                               _mm256_or_si256(_mm256_slli_epi32(level, 16), alpha));
+        _mm256_storeu_si256((__m256i *)(dst + i), pixels);
+    }
+    grayRow_scalar(src + i, dst + i, count - i);
+}
+
+FW_TARGET("avx2") static void blackAndWhiteRow_avx2(const QRgb * src, QRgb * dst, int count)
+{
+    const __m256i threshold = _mm256_set1_epi32(127);
+    const __m256i rgbMask = _mm256_set1_epi32(0x00ffffff);
+    const __m256i alpha = _mm256_set1_epi32((int)0xff000000);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i white = _mm256_cmpgt_epi32(averages_avx2(src + i), threshold);
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_or_si256(_mm256_and_si256(white, rgbMask), alpha));
+    }
+    blackAndWhiteRow_scalar(src + i, dst + i, count - i);
+}
+
+FW_TARGET("avx2") static void sumLookupRow_avx2(const QRgb * src, QRgb * dst, int count, const QRgb * table)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i pixels = _mm256_i32gather_epi32((const int *)table, sums_avx2(src + i), 4);
+        _mm256_storeu_si256((__m256i *)(dst + i), pixels);
+    }
+    sumLookupRow_scalar(src + i, dst + i, count - i, table);
+}
+
+// the three channels of 8 pixels, each gathered from its own lookup table
+FW_TARGET("avx2") static inline void channelGather_avx2(const QRgb * src, const quint32 * luts, __m256i & r, __m256i & g, __m256i & b, __m256i & a)
+{
+    const __m256i p = _mm256_loadu_si256((const __m256i *)src);
+    const __m256i mask = _mm256_set1_epi32(0xff);
+    const __m256i rIndex = _mm256_and_si256(_mm256_srli_epi32(p, 16), mask);
+    const __m256i gIndex = _mm256_add_epi32(_mm256_and_si256(_mm256_srli_epi32(p, 8), mask), _mm256_set1_epi32(256));
+    const __m256i bIndex = _mm256_add_epi32(_mm256_and_si256(p, mask), _mm256_set1_epi32(512));
+    r = _mm256_i32gather_epi32((const int *)luts, rIndex, 4);
+    g = _mm256_i32gather_epi32((const int *)luts, gIndex, 4);
+    b = _mm256_i32gather_epi32((const int *)luts, bIndex, 4);
+    a = _mm256_and_si256(p, _mm256_set1_epi32((int)0xff000000));
+}
+
+FW_TARGET("avx2") static void channelLookupRow_avx2(const QRgb * src, QRgb * dst, int count, const quint32 * luts)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i r, g, b, a;
+        channelGather_avx2(src + i, luts, r, g, b, a);
+        const __m256i pixels = _mm256_or_si256(_mm256_or_si256(a, _mm256_slli_epi32(r, 16)),
+                                               _mm256_or_si256(_mm256_slli_epi32(g, 8), b));
+        _mm256_storeu_si256((__m256i *)(dst + i), pixels);
+    }
+    channelLookupRow_scalar(src + i, dst + i, count - i, luts);
+}
+
+FW_TARGET("avx2") static void channelSumLookupRow_avx2(const QRgb * src, QRgb * dst, int count, const quint32 * luts, const QRgb * table)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i r, g, b, a;
+        channelGather_avx2(src + i, luts, r, g, b, a);
+        const __m256i sums = _mm256_add_epi32(_mm256_add_epi32(r, g), b);
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_i32gather_epi32((const int *)table, sums, 4));
+    }
+    channelSumLookupRow_scalar(src + i, dst + i, count - i, luts, table);
+}
+#endif
+
+
+/// Dispatchers
+void ColorKernels::grayRow(const QRgb * src, QRgb * dst, int count)
+{
+#if defined(FW_X86_SIMD)
+    switch (isa()) {
+        case IsaAVX2: grayRow_avx2(src, dst, count); return;
+        case IsaSSE2: grayRow_sse2(src, dst, count); return;
+        default: break;
+    }
+#endif
+    grayRow_scalar(src, dst, count);
+}
+
+void ColorKernels::blackAndWhiteRow(const QRgb * src, QRgb * dst, int count)
+{
+#if defined(FW_X86_SIMD)
+    switch (isa()) {
+        case IsaAVX2: blackAndWhiteRow_avx2(src, dst, count); return;
+        case IsaSSE2: blackAndWhiteRow_sse2(src, dst, count); return;
+        default: break;
+    }
+#endif
+    blackAndWhiteRow_scalar(src, dst, count);
+}
+
+void ColorKernels::sumLookupRow(const QRgb * src, QRgb * dst, int count, const QRgb * table)
+{
+#if defined(FW_X86_SIMD)
+    switch (isa()) {
+        case IsaAVX2: sumLookupRow_avx2(src, dst, count, table); return;
+        case IsaSSE2: sumLookupRow_sse2(src, dst, count, table); return;
+        default: break;
+    }
+#endif
+    sumLookupRow_scalar(src, dst, count, table);
+}
+
+// SSE2 has no gathers: the lookups run the scalar loops
+void ColorKernels::channelLookupRow(const QRgb * src, QRgb * dst, int count, const quint32 * luts)
+{
+#if defined(FW_X86_SIMD)
+    if (isa() == IsaAVX2) {
+        channelLookupRow_avx2(src, dst, count, luts);
+        return;
+    }
+#endif
+    channelLookupRow_scalar(src, dst, count, luts);
+}
+
+void ColorKernels::channelSumLookupRow(const QRgb * src, QRgb * dst, int count, const quint32 * luts, const QRgb * table)
+{
+#if defined(FW_X86_SIMD)
+    if (isa() == IsaAVX2) {
+        channelSumLookupRow_avx2(src, dst, count, luts, table);
+        return;
+    }
+#endif
+    channelSumLookupRow_scalar(src, dst, count, luts, table);
+}
+
+struct SepiaTable {
+    SepiaTable()
+    {
+        // same arithmetic (and truncations) of the original QColor loop
+        for (int sum = 0; sum < 766; ++sum) {
+            unsigned int average = sum / 3;
+            int red = average*1.176, green = average*0.837, blue = average*0.558;
+            table[sum] = qRgb((red <= 255) ? red : 255, (green <= 255) ? green : 255, (blue <= 255) ? blue : 255);
+        }
+    }
+    QRgb table[766];
+};
+Q_GLOBAL_STATIC(SepiaTable, s_sepiaTable)
+
+const QRgb * ColorKernels::sepiaTable()
+{
+    return s_sepiaTable()->table;
+}
+
+
+/// Image helpers
+QImage ColorKernels::to32bpp(const QImage & image)
+{
+    switch (image.format()) {
+        case QImage::Format_RGB32:
+        case QImage::Format_ARGB32:
+        case QImage::Format_ARGB32_Premultiplied:
+            return image;
+        default:
+            return image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32);
+    }
+}
+
+typedef void (*RowKernel)(const QRgb * src, QRgb * dst, int count);
+static QImage processRows(const QImage & image, RowKernel kernel)
+{
+    const QImage src = to32bpp(image);
+    QImage dst(src.size(), src.format());
+    const int width = src.width();
+    for (int y = 0; y < src.height(); ++y)
+        kernel((const QRgb *)src.scanLine(y), (QRgb *)dst.scanLine(y), width);
+    return dst;
+}
+
+QImage ColorKernels::gray(const QImage & image)
+{
+    return processRows(image, grayRow);
+}
+
+QImage ColorKernels::blackAndWhite(const QImage & image)
+{
+    return processRows(image, blackAndWhiteRow);
+}
+
+QImage ColorKernels::sepia(const QImage & image)
+{
+    const QImage src = to32bpp(image);
+    QImage dst(src.size(), src.format());
+    const QRgb * table = sepiaTable();
+    const int width = src.width();
+    for (int y = 0; y < src.height(); ++y)
+        sumLookupRow((const QRgb *)src.scanLine(y), (QRgb *)dst.scanLine(y), width, table);
+    return dst;
+}
@@ -0,0 +1,60 @@
+/***************************************************************************
+ *                                                                         *
+ *   This file is part of the FotoWall project,                            *
+ *       http://code.google.com/p/fotowall                                 *
+ *                                                                         *
+ *   Copyright (C) 2009 by Enrico Ros <enrico.ros@gmail.com>               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __ColorKernels_h__
+#define __ColorKernels_h__
+
+#include <QColor>
+#include <QImage>
+
+/**
+    \brief Row-major per-pixel color kernels, with SSE2/AVX2 paths
+
+    All the kernels work on 32bpp scanlines and produce the very same bits of
+    the original QColor based loops (the alpha of the result is always 255).
+    The fastest instruction set is detected at runtime; 'src' and 'dst' rows
+    may be the same memory.
+*/
+namespace ColorKernels
+{
+    enum Isa { IsaScalar = 0, IsaSSE2 = 1, IsaAVX2 = 2 };
+
+    // instruction set selection (setIsa can only downgrade the detected one)
+    Isa detectedIsa();
+    Isa isa();
+    void setIsa(Isa isa);
+    const char * isaName(Isa isa);
+
+    // scanline kernels
+    void grayRow(const QRgb * src, QRgb * dst, int count);
+    void blackAndWhiteRow(const QRgb * src, QRgb * dst, int count);
+    void sumLookupRow(const QRgb * src, QRgb * dst, int count, const QRgb * sumTable);
+
+    // per-channel lookups: 'luts' holds 3 x 256 entries (red, green, blue)
+    // channelLookupRow maps each channel and keeps the alpha, while
+    // channelSumLookupRow indexes 'sumTable' with the sum of the mapped channels
+    void channelLookupRow(const QRgb * src, QRgb * dst, int count, const quint32 * luts);
+    void channelSumLookupRow(const QRgb * src, QRgb * dst, int count, const quint32 * luts, const QRgb * sumTable);
+
+    // the 766 entries table used by Sepia (indexed by 'r + g + b')
+    const QRgb * sepiaTable();
+
+    // whole-image helpers (the result has the same size of the source)
+    QImage to32bpp(const QImage & image);
+    QImage gray(const QImage & image);
+    QImage blackAndWhite(const QImage & image);
+    QImage sepia(const QImage & image);
+}
+
+#endif
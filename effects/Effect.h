@@ -0,0 +1,40 @@
+/***************************************************************************
+ *                                                                         *
+ *   This file is part of the FotoWall project,                            *
+ *       http://code.google.com/p/fotowall                                 *
+ *                                                                         *
+ *   Copyright (C) 2009 by Enrico Ros <enrico.ros@gmail.com>               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __Effect_h__
+#define __Effect_h__
+
+#include <QtGlobal>
+
+/**
+    \brief One step of the effects list of a picture (saved as 'type' and 'param')
+
+    The 'param' is the radius for Glow, the offset of the levels (-255..255)
+    for Brightness, the change in percent (-100..100) for Contrast and the
+    exponent (1 = unchanged, > 1 brightens the midtones) for Gamma.
+*/
+struct CEffect {
+    enum Effect {
+        ClearEffects = -1,  FlipH = 1,      FlipV = 2,
+        InvertColors = 3,   NVG = 4,        BlackAndWhite = 5,
+        Glow = 6,           Sepia = 7,      Brightness = 8,
+        Contrast = 9,       Gamma = 10
+    } effect;
+    qreal param;
+
+    CEffect(Effect effect = ClearEffects, qreal param = 0.0) : effect(effect), param(param) {}
+    bool operator==(const CEffect & other) const { return effect == other.effect && param == other.param; }
+};
+
+#endif
@@ -0,0 +1,223 @@
+/***************************************************************************
+ *                                                                         *
+ *   This file is part of the FotoWall project,                            *
+ *       http://code.google.com/p/fotowall                                 *
+ *                                                                         *
+ *   Copyright (C) 2009 by Enrico Ros <enrico.ros@gmail.com>               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "EffectChain.h"
+#include "Blur.h"
+#include "ColorKernels.h"
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#define SUM_ENTRIES 766     // 0 ... 255 * 3
+
+EffectChain::Pass::Pass(Type type)
+    : type(type)
+    , hFlip(false)
+    , vFlip(false)
+    , radius(0)
+{
+}
+
+bool EffectChain::Pass::isIdentity() const
+{
+    return type == Pixel && !hFlip && !vFlip && channelLuts.isEmpty() && sumTable.isEmpty();
+}
+
+EffectChain::EffectChain(const QList<CEffect> & effects, qreal scale)
+    : m_scale(scale)
+{
+    setEffects(effects);
+}
+
+void EffectChain::setEffects(const QList<CEffect> & effects)
+{
+    m_passes.clear();
+    Pass pixel;
+    foreach (const CEffect & effect, effects) {
+        switch (effect.effect) {
+            case CEffect::ClearEffects:
+                m_passes.clear();
+                pixel = Pass();
+                break;
+
+            // flips commute with per-pixel effects: just remap the output
+            case CEffect::FlipH:
+                pixel.hFlip = !pixel.hFlip;
+                break;
+            case CEffect::FlipV:
+                pixel.vFlip = !pixel.vFlip;
+                break;
+
+            // the same mapping on each channel, alpha untouched
+            case CEffect::InvertColors:
+            case CEffect::Brightness:
+            case CEffect::Contrast:
+            case CEffect::Gamma:
+                foldChannelEffect(pixel, effect);
+                break;
+
+            // effects that only depend on 'r + g + b'
+            case CEffect::NVG:
+            case CEffect::BlackAndWhite:
+            case CEffect::Sepia:
+                foldSumEffect(pixel, effect.effect);
+                break;
+
+            // spatial effects close the current pass
+            case CEffect::Glow: {
+                if (!pixel.isIdentity())
+                    m_passes.append(pixel);
+                pixel = Pass();
+                Pass glow(Pass::Glow);
+                glow.radius = qRound(effect.param * m_scale);
+                if (effect.param >= 1.0)
+                    glow.radius = qMax(1, glow.radius);
+                m_passes.append(glow);
+                } break;
+        }
+    }
+    if (!pixel.isIdentity())
+        m_passes.append(pixel);
+}
+
+int EffectChain::passCount() const
+{
+    return m_passes.size();
+}
+
+QImage EffectChain::apply(const QImage & source) const
+{
+    QImage image = source;
+    if (image.isNull())
+        return image;
+    foreach (const Pass & pass, m_passes) {
+        if (pass.type == Pass::Glow)
+            image = Blur::glow(image, pass.radius);
+        else
+            image = runPixelPass(image, pass);
+    }
+    return image;
+}
+
+// the level mapping of a per-channel effect
+static void channelMap(const CEffect & effect, int map[256])
+{
+    for (int v = 0; v < 256; ++v) {
+        switch (effect.effect) {
+            // as QImage::invertPixels on 32bpp pixels
+            case CEffect::InvertColors:
+                map[v] = 255 - v;
+                break;
+            case CEffect::Brightness:
+                map[v] = qRound(v + effect.param);
+                break;
+            case CEffect::Contrast:
+                map[v] = qRound(128 + (v - 128) * (100.0 + effect.param) / 100.0);
+                break;
+            case CEffect::Gamma:
+                map[v] = effect.param > 0.0 ? qRound(255.0 * pow(v / 255.0, 1.0 / effect.param)) : v;
+                break;
+            default:
+                qWarning("EffectChain::channelMap: effect %d is not a channel effect", effect.effect);
+                map[v] = v;
+                break;
+        }
+        map[v] = qBound(0, map[v], 255);
+    }
+}
+
+void EffectChain::foldChannelEffect(Pass & pass, const CEffect & effect)
+{
+    int map[256];
+    channelMap(effect, map);
+
+    // after a sum effect: remap the channels of the table entries
+    if (!pass.sumTable.isEmpty()) {
+        for (int i = 0; i < SUM_ENTRIES; ++i) {
+            const QRgb p = pass.sumTable[i];
+            pass.sumTable[i] = qRgba(map[qRed(p)], map[qGreen(p)], map[qBlue(p)], qAlpha(p));
+        }
+        return;
+    }
+
+    // else compose with the current channel tables
+    if (pass.channelLuts.isEmpty()) {
+        pass.channelLuts.resize(3 * 256);
+        for (int i = 0; i < 3 * 256; ++i)
+            pass.channelLuts[i] = i & 0xff;
+    }
+    bool identity = true;
+    for (int i = 0; i < 3 * 256; ++i) {
+        pass.channelLuts[i] = map[pass.channelLuts[i]];
+        identity &= pass.channelLuts[i] == (quint32)(i & 0xff);
+    }
+    if (identity)
+        pass.channelLuts.clear();
+}
+
+static QRgb pixelWithSum(int sum)
+{
+    const int r = qMin(sum, 255);
+    const int g = qMin(sum - r, 255);
+    return qRgb(r, g, sum - r - g);
+}
+
+void EffectChain::foldSumEffect(Pass & pass, CEffect::Effect effect)
+{
+    // the new table maps the sum of the looked up source channels to the
+    // result of the whole pass (the effect only depends on the sum it sees)
+    QVector<QRgb> table(SUM_ENTRIES);
+    for (int sum = 0; sum < SUM_ENTRIES; ++sum) {
+        QRgb pixel = pass.sumTable.isEmpty() ? pixelWithSum(sum) : pass.sumTable[sum];
+        switch (effect) {
+            case CEffect::NVG:
+                ColorKernels::grayRow(&pixel, &pixel, 1);
+                break;
+            case CEffect::BlackAndWhite:
+                ColorKernels::blackAndWhiteRow(&pixel, &pixel, 1);
+                break;
+            case CEffect::Sepia:
+                ColorKernels::sumLookupRow(&pixel, &pixel, 1, ColorKernels::sepiaTable());
+                break;
+            default:
+                qWarning("EffectChain::foldSumEffect: effect %d is not a sum effect", effect);
+                break;
+        }
+        table[sum] = pixel;
+    }
+    pass.sumTable = table;
+}
+
+QImage EffectChain::runPixelPass(const QImage & image, const Pass & pass)
+{
+    const QImage src = ColorKernels::to32bpp(image);
+    QImage dst(src.size(), src.format());
+    const int width = src.width();
+    const int height = src.height();
+    for (int y = 0; y < height; ++y) {
+        const QRgb * srcLine = (const QRgb *)src.scanLine(y);
+        QRgb * dstLine = (QRgb *)dst.scanLine(pass.vFlip ? height - 1 - y : y);
+        if (!pass.sumTable.isEmpty() && !pass.channelLuts.isEmpty())
+            ColorKernels::channelSumLookupRow(srcLine, dstLine, width, pass.channelLuts.constData(), pass.sumTable.constData());
+        else if (!pass.sumTable.isEmpty())
+            ColorKernels::sumLookupRow(srcLine, dstLine, width, pass.sumTable.constData());
+        else if (!pass.channelLuts.isEmpty())
+            ColorKernels::channelLookupRow(srcLine, dstLine, width, pass.channelLuts.constData());
+        else
+            memcpy(dstLine, srcLine, width * sizeof(QRgb));
+        if (pass.hFlip)
+            std::reverse(dstLine, dstLine + width);
+    }
+    return dst;
+}
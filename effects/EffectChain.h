@@ -0,0 +1,68 @@
+/***************************************************************************
+ *                                                                         *
+ *   This file is part of the FotoWall project,                            *
+ *       http://code.google.com/p/fotowall                                 *
+ *                                                                         *
+ *   Copyright (C) 2009 by Enrico Ros <enrico.ros@gmail.com>               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __EffectChain_h__
+#define __EffectChain_h__
+
+#include <QImage>
+#include <QList>
+#include <QVector>
+#include "Effect.h"
+
+/**
+    \brief Compiles a list of CEffects into the fewest passes over the pixels
+
+    Consecutive per-pixel effects collapse into one pass: the per-channel ones
+    (Invert, Brightness, Contrast, Gamma) into 3 lookup tables of 256 entries,
+    the ones depending on 'r + g + b' (NVG, B&W, Sepia) into a table indexed
+    by the sum of the looked up channels. Channel effects coming after a sum
+    one are folded into the entries of the sum table. Flips become a remap of
+    the destination indices of the same pass. Only spatial effects (Glow) split
+    the chain in more passes.
+
+    Effect parameters are in pixels of the original image: 'scale' fits the
+    spatial ones to a copy of it resized by that factor.
+*/
+class EffectChain
+{
+    public:
+        EffectChain(const QList<CEffect> & effects = QList<CEffect>(), qreal scale = 1.0);
+
+        // (re)compile the chain
+        void setEffects(const QList<CEffect> & effects);
+        int passCount() const;
+
+        // run the compiled passes over a copy of 'source' (from any thread)
+        QImage apply(const QImage & source) const;
+
+    private:
+        struct Pass {
+            enum Type { Pixel, Glow } type;
+            bool hFlip;
+            bool vFlip;
+            QVector<quint32> channelLuts;   // 3 x 256, empty if identity
+            QVector<QRgb> sumTable;
+            int radius;
+
+            Pass(Type type = Pixel);
+            bool isIdentity() const;
+        };
+        static void foldChannelEffect(Pass & pass, const CEffect & effect);
+        static void foldSumEffect(Pass & pass, CEffect::Effect effect);
+        static QImage runPixelPass(const QImage & image, const Pass & pass);
+        qreal m_scale;
+        QList<Pass> m_passes;
+};
+
+#endif
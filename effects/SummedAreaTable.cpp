@@ -0,0 +1,106 @@
+/***************************************************************************
+ *                                                                         *
+ *   This file is part of the FotoWall project,                            *
+ *       http://code.google.com/p/fotowall                                 *
+ *                                                                         *
+ *   Copyright (C) 2009 by Enrico Ros <enrico.ros@gmail.com>               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "SummedAreaTable.h"
+#include "ColorKernels.h"
+#include <math.h>
+
+// the exponential kernel is approximated by a stair of centered boxes, whose
+// half sizes are these fractions of (radius + 1)
+#define STAIR_STEPS 4
+static const float s_stairEdges[STAIR_STEPS] = { 0.15f, 0.4f, 0.8f, 1.5f };
+
+SummedAreaTable::SummedAreaTable(const QImage & image)
+    : m_source(ColorKernels::to32bpp(image))
+    , m_width(image.width())
+    , m_height(image.height())
+{
+    if (m_source.isNull())
+        return;
+
+    // row 0 and column 0 stay zero: sums are 'up to, excluded'
+    const int stride = (m_width + 1) * 4;
+    m_sums.fill(0, stride * (m_height + 1));
+    quint32 * sums = m_sums.data();
+    const QImage & source = m_source;
+    for (int y = 0; y < m_height; ++y) {
+        const QRgb * line = (const QRgb *)source.scanLine(y);
+        const quint32 * above = sums + y * stride;
+        quint32 * current = sums + (y + 1) * stride;
+        quint32 rowSum[4] = { 0, 0, 0, 0 };
+        for (int x = 0; x < m_width; ++x) {
+            for (int c = 0; c < 4; ++c) {
+                rowSum[c] += (line[x] >> (c * 8)) & 0xff;
+                current[(x + 1) * 4 + c] = above[(x + 1) * 4 + c] + rowSum[c];
+            }
+        }
+    }
+}
+
+bool SummedAreaTable::isNull() const
+{
+    return m_sums.isEmpty();
+}
+
+QImage SummedAreaTable::expBlur(int radius) const
+{
+    if (isNull() || radius < 1)
+        return m_source;
+
+    // the 1D kernel of expblur decays as exp(-2.3 * d / (radius + 1)): sample
+    // it at the middle of each step of the stair, and make every box weight
+    // the difference from the next step. 2D boxes are the products of 1D ones
+    int half[STAIR_STEPS];
+    float level[STAIR_STEPS + 1];
+    for (int i = 0; i < STAIR_STEPS; ++i) {
+        half[i] = qMax(i ? half[i - 1] : 0, (int)(s_stairEdges[i] * (radius + 1) + 0.5f));
+        const float middle = 0.5f * ((i ? half[i - 1] + 1 : 0) + half[i]);
+        level[i] = expf(-2.3f * middle / (radius + 1));
+    }
+    level[STAIR_STEPS] = 0.0f;
+    float weight[STAIR_STEPS];
+    for (int i = 0; i < STAIR_STEPS; ++i)
+        weight[i] = level[i] - level[i + 1];
+
+    QImage result(m_width, m_height, m_source.format());
+    const int stride = (m_width + 1) * 4;
+    const quint32 * sums = m_sums.constData();
+    for (int y = 0; y < m_height; ++y) {
+        QRgb * line = (QRgb *)result.scanLine(y);
+        for (int x = 0; x < m_width; ++x) {
+            float accum[4] = { 0, 0, 0, 0 };
+            float area = 0;
+            for (int i = 0; i < STAIR_STEPS; ++i) {
+                // clipped rows of the box: the weights renormalize on the edges
+                const int y0 = qMax(y - half[i], 0);
+                const int y1 = qMin(y + half[i] + 1, m_height);
+                const quint32 * top = sums + y0 * stride;
+                const quint32 * bottom = sums + y1 * stride;
+                for (int j = 0; j < STAIR_STEPS; ++j) {
+                    const int x0 = qMax(x - half[j], 0) * 4;
+                    const int x1 = qMin(x + half[j] + 1, m_width) * 4;
+                    const float w = weight[i] * weight[j];
+                    for (int c = 0; c < 4; ++c)
+                        accum[c] += w * (float)(bottom[x1 + c] - bottom[x0 + c] - top[x1 + c] + top[x0 + c]);
+                    area += w * (float)((x1 - x0) / 4 * (y1 - y0));
+                }
+            }
+            QRgb pixel = 0;
+            for (int c = 0; c < 4; ++c)
+                pixel |= (QRgb)qMin((int)(accum[c] / area + 0.5f), 255) << (c * 8);
+            line[x] = pixel;
+        }
+    }
+    return result;
+}
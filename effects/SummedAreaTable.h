@@ -0,0 +1,46 @@
+/***************************************************************************
+ *                                                                         *
+ *   This file is part of the FotoWall project,                            *
+ *       http://code.google.com/p/fotowall                                 *
+ *                                                                         *
+ *   Copyright (C) 2009 by Enrico Ros <enrico.ros@gmail.com>               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __SummedAreaTable_h__
+#define __SummedAreaTable_h__
+
+#include <QImage>
+#include <QVector>
+
+/**
+    \brief Per-channel running sums of an image, for blurs of any radius
+
+    Built once in linear time; then the sum over any rectangle costs four
+    lookups, so blurring has the same cost per pixel at every radius.
+    Meant for interactive previews (small images): the exact result comes
+    from the Blur functions.
+*/
+class SummedAreaTable
+{
+    public:
+        SummedAreaTable(const QImage & image = QImage());
+
+        bool isNull() const;
+
+        // approximation of Blur::expBlur(radius), made of a few box blurs
+        QImage expBlur(int radius) const;
+
+    private:
+        QImage m_source;
+        int m_width;
+        int m_height;
+        QVector<quint32> m_sums;    // (w + 1) x (h + 1) x 4 channels
+};
+
+#endif
@@ -0,0 +1,12 @@
+VPATH += $$PWD
+DEPENDPATH += $$PWD
+
+HEADERS += Blur.h \
+    ColorKernels.h \
+    Effect.h \
+    EffectChain.h \
+    SummedAreaTable.h
+SOURCES += Blur.cpp \
+    ColorKernels.cpp \
+    EffectChain.cpp \
+    SummedAreaTable.cpp
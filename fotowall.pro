@@ -14,27 +14,49 @@ QT = core \
 
 # FotoWall input files
 HEADERS += 3rdparty/gsuggest.h \
+    BandedImageWriter.h \
     CPixmap.h \
     Desk.h \
+    EffectBatch.h \
     ExactSizeDialog.h \
+    ExifThumbnail.h \
     ExportWizard.h \
+    FolderImporter.h \
     FotoWall.h \
     GlowEffectDialog.h \
     GlowEffectWidget.h \
+    ImageCache.h \
+    ItemCachePolicy.h \
     ModeInfo.h \
+    PictureLoader.h \
     RenderOpts.h \
+    RenderSnapshot.h \
+    ScanlineReader.h \
+    ThumbnailCache.h \
+    TiledImage.h \
     XmlSave.h \
     XmlRead.h
 SOURCES += 3rdparty/gsuggest.cpp \
     main.cpp \
+    BandedImageWriter.cpp \
     CPixmap.cpp \
     Desk.cpp \
+    EffectBatch.cpp \
     ExactSizeDialog.cpp \
+    ExifThumbnail.cpp \
     ExportWizard.cpp \
+    FolderImporter.cpp \
     FotoWall.cpp \
     GlowEffectDialog.cpp \
     GlowEffectWidget.cpp \
+    ImageCache.cpp \
+    ItemCachePolicy.cpp \
     ModeInfo.cpp \
+    PictureLoader.cpp \
+    RenderSnapshot.cpp \
+    ScanlineReader.cpp \
+    ThumbnailCache.cpp \
+    TiledImage.cpp \
     XmlSave.cpp \
     XmlRead.cpp
 FORMS += ExactSizeDialog.ui \
@@ -50,10 +72,40 @@ TRANSLATIONS += translations/fotowall_de.ts \
 # Sub-Components
 include(items/items.pri)
 include(frames/frames.pri)
+include(effects/effects.pri)
 include(3rdparty/richtextedit/richtextedit.pri)
 include(3rdparty/videocapture/videocapture.pri)
 include(3rdparty/posterazor/posterazor.pri)
 
+# streamed PNG export: zlib is in the system on Linux and Mac (the unix
+# scope), on Windows point ZLIB_DIR to a build of it. without, PNG files
+# are saved by QImage, rendered in memory as a whole
+unix {
+    DEFINES += HAS_ZLIB
+    LIBS += -lz
+}
+win32:exists($$(ZLIB_DIR)/include/zlib.h) {
+    DEFINES += HAS_ZLIB
+    INCLUDEPATH += $$(ZLIB_DIR)/include
+    LIBS += -L$$(ZLIB_DIR)/lib -lz
+}
+
+# streamed tiling of very large pictures, through the system decoders that
+# are asked for (e.g. qmake CONFIG+=stream_jpeg CONFIG+=stream_png). without,
+# only the Qt readers that can clip are used, see TiledImage
+stream_jpeg {
+    DEFINES += HAS_LIBJPEG
+    LIBS += -ljpeg
+}
+stream_png {
+    DEFINES += HAS_LIBPNG
+    LIBS += -lpng
+}
+stream_tiff {
+    DEFINES += HAS_LIBTIFF
+    LIBS += -ltiff
+}
+
 # deployment on Linux
 unix {
     target.path = /usr/bin
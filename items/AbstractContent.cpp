@@ -15,6 +15,8 @@
 #include "AbstractContent.h"
 #include "ButtonItem.h"
 #include "CornerItem.h"
+#include "CPixmap.h"
+#include "ItemCachePolicy.h"
 #include "MirrorItem.h"
 #include "RenderOpts.h"
 #include "frames/FrameFactory.h"
@@ -97,6 +99,7 @@ AbstractContent::AbstractContent(QGraphicsScene * scene, QGraphicsItem * parent,
 
 AbstractContent::~AbstractContent()
 {
+    ItemCachePolicy::instance()->removeContent(this);
     qDeleteAll(m_cornerItems);
     qDeleteAll(m_controlItems);
     delete m_mirrorItem;
@@ -152,6 +155,9 @@ void AbstractContent::delayedDirty(int ms)
         m_transformRefreshTimer->setSingleShot(true);
     }
     m_transformRefreshTimer->start(ms);
+
+    // don't cache what changes at every move
+    ItemCachePolicy::instance()->apply(this);
 }
 
 void AbstractContent::setFrame(Frame * frame)
@@ -440,12 +446,16 @@ QRectF AbstractContent::boundingRect() const
     return m_frameRect;
 }
 
-void AbstractContent::paint(QPainter * painter, const QStyleOptionGraphicsItem * /*option*/, QWidget * /*widget*/)
+void AbstractContent::paint(QPainter * painter, const QStyleOptionGraphicsItem * option, QWidget * /*widget*/)
 {
     const bool opaqueContent = contentOpaque();
     const bool drawSelection = RenderOpts::HQRendering ? false : isSelected();
     const QRect frameRect = m_frameRect.toRect();
 
+    // count the repaints of the scene (the mirror paints us without options)
+    if (option)
+        ItemCachePolicy::instance()->painted(this);
+
     if (!m_frame) {
         // draw the selection only as done in EmptyFrame.cpp
         if (drawSelection) {
@@ -466,8 +476,15 @@ void AbstractContent::paint(QPainter * painter, const QStyleOptionGraphicsItem *
 
 void AbstractContent::GFX_CHANGED() const
 {
+    // drop the cached rendering of the content
+    ItemCachePolicy::instance()->invalidate(const_cast<AbstractContent *>(this));
+
+    // regenerate the mirror, a bit later
     if (m_gfxChangeTimer && m_mirrorItem)
         m_gfxChangeTimer->start();
+
+    // and any other copy of the pixels (the desk's content layer)
+    emit const_cast<AbstractContent *>(this)->contentChanged();
 }
 
 void AbstractContent::setControlsVisible(bool visible)
@@ -538,6 +555,10 @@ QVariant AbstractContent::itemChange(GraphicsItemChange change, const QVariant &
         }
     }
 
+    // changes that affect the cached rendering (with a mirror, GFX_CHANGED does it)
+    if (!m_mirrorItem && (change == ItemTransformHasChanged || change == ItemSelectedHasChanged))
+        ItemCachePolicy::instance()->invalidate(this);
+
     // changes that affect the mirror item
     if (m_mirrorItem) {
         switch (change) {
@@ -640,6 +661,8 @@ void AbstractContent::slotSaveAs()
     }
     p.end();
     RenderOpts::HQRendering = prevHQ;
+    if (!prevHQ)
+        CPixmap::releaseFullResolution();
 
     // save image and check errors
     if (!image.save(fileName) || !QFile::exists(fileName)) {
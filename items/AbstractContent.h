@@ -77,6 +77,7 @@ class AbstractContent : public QObject, public QGraphicsItem
         void changeStack(int opcode);
         void backgroundMe();
         void deleteItem();
+        void contentChanged();
 
     protected:
         // useful to subclasses
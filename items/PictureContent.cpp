@@ -15,7 +15,11 @@
 #include "PictureContent.h"
 #include "ButtonItem.h"
 #include "CPixmap.h"
+#include "ExifThumbnail.h"
 #include "RenderOpts.h"
+#include "RenderSnapshot.h"
+#include "ThumbnailCache.h"
+#include "TiledImage.h"
 #include "frames/Frame.h"
 #include <QFileInfo>
 #include <QGraphicsScene>
@@ -23,11 +27,18 @@
 #include <QMimeData>
 #include <QPainter>
 #include <QUrl>
+#include <QtConcurrentRun>
 
 PictureContent::PictureContent(QGraphicsScene * scene, QGraphicsItem * parent)
     : AbstractContent(scene, parent, false)
     , m_photo(0)
+    , m_tiledPhoto(0)
+    , m_photoGeneration(0)
     , m_opaquePhoto(false)
+    , m_placeholder(false)
+    , m_previewPhoto(false)
+    , m_rescaleWatcher(0)
+    , m_rescaleGeneration(0)
 {
     // enable frame text
     setFrameTextEnabled(true);
@@ -49,43 +60,181 @@ PictureContent::PictureContent(QGraphicsScene * scene, QGraphicsItem * parent)
 
 PictureContent::~PictureContent()
 {
+    // a rescale still running just finishes on its own copy
+    delete m_rescaleWatcher;
+    delete m_tiledPhoto;
     delete m_photo;
 }
 
 bool PictureContent::loadPhoto(const QString & fileName, bool keepRatio, bool setName)
 {
+    QSize fullSize;
+    QImage image = CPixmap::loadForDisplay(fileName, &fullSize);
+    ThumbnailCache::store(fileName, image);
+    return loadDecodedPhoto(fileName, image, fullSize, keepRatio, setName);
+}
+
+void PictureContent::showPlaceholder(const QString & fileName)
+{
+    // show the thumbnail embedded by the camera, if any
+    QSize fullSize;
+    QImage thumbnail = ExifThumbnail::read(fileName, &fullSize);
+    if (!thumbnail.isNull() && loadPreviewPhoto(fileName, thumbnail, fullSize, true, true))
+        return;
+
+    m_placeholder = true;
+    m_filePath = fileName;
+    setNameFromFile(fileName);
+    update();
+}
+
+bool PictureContent::loadDecodedPhoto(const QString & fileName, const QImage & image, const QSize & fullSize, bool keepRatio, bool setName)
+{
+    return setPhoto(fileName, image, fullSize, keepRatio, setName, false);
+}
+
+bool PictureContent::setPhoto(const QString & fileName, const QImage & image, const QSize & fullSize, bool keepRatio, bool setName, bool preview)
+{
+    // upgrading a preview: keep what has been set on it meanwhile
+    QList<CEffect> effects;
+    if (m_previewPhoto && m_photo && fileName == m_filePath) {
+        // the file can't be decoded after all: don't pass the preview for it
+        if (image.isNull())
+            return false;
+        effects = m_photo->effects();
+        keepRatio = false;
+        setName = false;
+    }
+
+    // filling a placeholder: apply the effects set on it meanwhile
+    if (m_placeholder && fileName == m_filePath)
+        effects = m_pendingEffects;
+    m_pendingEffects.clear();
+    m_previewPhoto = false;
+
+    delete m_tiledPhoto;
+    m_tiledPhoto = 0;
     delete m_photo;
-    m_cachedPhoto = QPixmap();
     m_opaquePhoto = false;
-    m_photo = new CPixmap(fileName);
+    m_placeholder = false;
+    m_photo = image.isNull() ? new CPixmap() : new CPixmap(fileName, image, fullSize, preview);
     if (m_photo->isNull()) {
         delete m_photo;
         m_photo = 0;
         m_filePath = QString();
         return false;
     }
+    if (!effects.isEmpty())
+        m_photo->setEffects(effects);
     m_opaquePhoto = !m_photo->hasAlpha();
     m_filePath = fileName;
+    if (!preview && m_photo->isReduced() && TiledImage::isLarge(m_photo->fullSize()))
+        TiledImage::prepare(fileName);
     if (keepRatio)
         resetContentsRatio();
-    if (setName) {
-        QString string = QFileInfo(fileName).fileName().section('.', 0, 0);
-        string = string.mid(0, 10);
-        setFrameText(string + tr("..."));
-    }
+    if (setName)
+        setNameFromFile(fileName);
+    ++m_photoGeneration;
     update();
     GFX_CHANGED();
     return true;
 }
 
+bool PictureContent::loadPreviewPhoto(const QString & fileName, const QImage & preview, const QSize & fullSize, bool keepRatio, bool setName)
+{
+    m_previewPhoto = false;
+    if (!setPhoto(fileName, preview, fullSize, keepRatio, setName, true))
+        return false;
+    m_previewPhoto = true;
+    return true;
+}
+
+bool PictureContent::hasPreviewPhoto() const
+{
+    return m_previewPhoto;
+}
+
+void PictureContent::setNameFromFile(const QString & fileName)
+{
+    QString string = QFileInfo(fileName).fileName().section('.', 0, 0);
+    string = string.mid(0, 10);
+    setFrameText(string + tr("..."));
+}
+
+bool PictureContent::isPlaceholder() const
+{
+    return m_placeholder;
+}
+
 void PictureContent::addEffect(const CEffect & effect)
 {
+    // still loading: keep it for when the photo arrives
+    if (!m_photo) {
+        if (effect.effect == CEffect::ClearEffects)
+            m_pendingEffects.clear();
+        else
+            m_pendingEffects.append(effect);
+        return;
+    }
     m_photo->addEffect(effect);
-    m_cachedPhoto = QPixmap();
+    ++m_photoGeneration;
+    update();
+    GFX_CHANGED();
+}
+
+void PictureContent::setEffects(const QList<CEffect> & effects)
+{
+    if (!m_photo) {
+        m_pendingEffects.clear();
+        foreach (const CEffect & effect, effects)
+            addEffect(effect);
+        return;
+    }
+    m_photo->setEffects(effects);
+    ++m_photoGeneration;
     update();
     GFX_CHANGED();
 }
 
+QList<CEffect> PictureContent::effects() const
+{
+    return m_photo ? m_photo->effects() : m_pendingEffects;
+}
+
+QImage PictureContent::effectsBase(const QList<CEffect> & effects, QList<CEffect> * tail) const
+{
+    // don't decode here: a missing original is read by the worker
+    if (!m_photo) {
+        if (tail)
+            *tail = effects;
+        return QImage();
+    }
+    return m_photo->effectsBase(effects, tail, false);
+}
+
+void PictureContent::setEffectsResult(const QList<CEffect> & effects, const QImage & result)
+{
+    // nothing computed (e.g. the photo arrived meanwhile): apply them here
+    if (!m_photo || result.isNull()) {
+        setEffects(effects);
+        return;
+    }
+    m_photo->setEffectsResult(effects, result);
+    ++m_photoGeneration;
+    update();
+    GFX_CHANGED();
+}
+
+QString PictureContent::filePath() const
+{
+    return m_filePath;
+}
+
+qreal PictureContent::effectsScale() const
+{
+    return m_photo ? m_photo->displayScale() : 1.0;
+}
+
 bool PictureContent::fromXml(QDomElement & pe)
 {
     AbstractContent::fromXml(pe);
@@ -93,15 +242,21 @@ bool PictureContent::fromXml(QDomElement & pe)
     // load picture properties
     QString name = pe.firstChildElement("name").text();
     QString path = pe.firstChildElement("path").text();
-    bool ok = loadPhoto(path);
+    QSize fullSize;
+    QImage thumbnail = ThumbnailCache::find(path, &fullSize);
+    bool ok = thumbnail.isNull() ? loadPhoto(path) : loadPreviewPhoto(path, thumbnail, fullSize);
     if (ok) {
+        // restore the whole chain at once (a single pass over the pixels)
+        QList<CEffect> effects;
         QDomElement effectsE = pe.firstChildElement("effects");
         for (QDomElement effectE = effectsE.firstChildElement("effect"); effectE.isElement(); effectE = effectE.nextSiblingElement("effect")) {
             CEffect fx;
             fx.effect = (CEffect::Effect)effectE.attribute("type").toInt();
             fx.param = effectE.attribute("param").toDouble();
-            addEffect(fx);
+            effects.append(fx);
         }
+        if (!effects.isEmpty())
+            setEffects(effects);
     }
     return ok;
 }
@@ -126,7 +281,7 @@ void PictureContent::toXml(QDomElement & pe) const
     domElement = doc.createElement("effects");
     pe.appendChild(domElement);
     QString effectStr;
-    foreach (const CEffect & effect, m_photo->effects()) {
+    foreach (const CEffect & effect, effects()) {
         QDomElement effectElement = doc.createElement("effect");
         effectElement.setAttribute("type", effect.effect);
         effectElement.setAttribute("param", effect.param);
@@ -136,16 +291,38 @@ void PictureContent::toXml(QDomElement & pe) const
 
 QPixmap PictureContent::renderAsBackground(const QSize & size, bool keepAspect) const
 {
-    if (m_photo)
-        return m_photo->scaled(size, keepAspect ? Qt::KeepAspectRatio : Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
-    return AbstractContent::renderAsBackground(size, keepAspect);
+    if (!m_photo)
+        return AbstractContent::renderAsBackground(size, keepAspect);
+    const Qt::AspectRatioMode mode = keepAspect ? Qt::KeepAspectRatio : Qt::IgnoreAspectRatio;
+
+    // larger than the display pixels: go back to the file, by tiles if huge
+    TiledImage * tiled = tiledPhoto();
+    if (tiled && (size.width() > m_photo->width() || size.height() > m_photo->height())) {
+        QSize tiledSize = tiled->size();
+        tiledSize.scale(size, mode);
+        QImage image(tiledSize, QImage::Format_ARGB32_Premultiplied);
+        image.fill(0);
+        QPainter painter(&image);
+        painter.setRenderHint(QPainter::SmoothPixmapTransform);
+        if (tiled->draw(&painter, image.rect(), m_photo->effects())) {
+            painter.end();
+            return QPixmap::fromImage(image);
+        }
+    }
+    if (m_photo->isReduced() && !TiledImage::isLarge(m_photo->fullSize()) && (size.width() > m_photo->width() || size.height() > m_photo->height())) {
+        QImage full = m_photo->fullResolutionImage();
+        m_photo->releaseFullResolutionImage();
+        if (!full.isNull())
+            return QPixmap::fromImage(full.scaled(size, mode, Qt::SmoothTransformation));
+    }
+    return QPixmap::fromImage(m_photo->toImage().scaled(size, mode, Qt::SmoothTransformation));
 }
 
 int PictureContent::contentHeightForWidth(int width) const
 {
-    if (!m_photo || m_photo->width() < 1)
+    if (!m_photo || m_photo->fullSize().width() < 1)
         return -1;
-    return (m_photo->height() * width) / m_photo->width();
+    return (m_photo->fullSize().height() * width) / m_photo->fullSize().width();
 }
 
 bool PictureContent::contentOpaque() const
@@ -175,9 +352,12 @@ void PictureContent::paint(QPainter * painter, const QStyleOptionGraphicsItem *
     // paint parent
     AbstractContent::paint(painter, option, widget);
 
-    // skip if no photo
-    if (!m_photo)
+    // skip if no photo (just hint the pending ones)
+    if (!m_photo) {
+        if (m_placeholder && !RenderOpts::HQRendering)
+            painter->fillRect(contentsRect(), QColor(128, 128, 128, 64));
         return;
+    }
 
     // blit if opaque picture
 #if QT_VERSION >= 0x040500
@@ -190,23 +370,89 @@ void PictureContent::paint(QPainter * painter, const QStyleOptionGraphicsItem *
     QRect targetRect = contentsRect();
     if (RenderOpts::HQRendering) {
         painter->setRenderHints(QPainter::Antialiasing | QPainter::SmoothPixmapTransform);
-        painter->drawPixmap(targetRect, *m_photo);
+        TiledImage * tiled = tiledPhoto();
+        if (tiled && tiled->draw(painter, targetRect, m_photo->effects()))
+            return;
+        // recording a snapshot: the original is decoded while replaying it
+        if (m_photo->isReduced() && !TiledImage::isLarge(m_photo->fullSize()) && dynamic_cast<RenderSnapshot *>(painter->device())) {
+            RenderSnapshot::drawSource(painter, targetRect, m_photo->fullResolutionSource());
+            return;
+        }
+        QImage full;
+        if (!TiledImage::isLarge(m_photo->fullSize()))
+            full = m_photo->fullResolutionImage();
+        if (full.isNull())
+            full = m_photo->toImage();
+        painter->drawImage(targetRect, full);
         return;
     }
 
-    // draw photo using caching and deferred rescales
-    if (beingTransformed()) {
-        if (!m_cachedPhoto.isNull())
-            painter->drawPixmap(targetRect, m_cachedPhoto);
-    } else {
-        if (m_cachedPhoto.isNull() || m_cachedPhoto.size() != targetRect.size())
-            m_cachedPhoto = m_photo->scaled(targetRect.size(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
-        painter->setRenderHints(QPainter::SmoothPixmapTransform);
-        painter->drawPixmap(targetRect.topLeft(), m_cachedPhoto);
+    // draw photo using caching and deferred rescales (the scaled copy is in
+    // the ImageCache, regenerated if evicted)
+    QPixmap cachedPhoto = m_photo->cachedScaled(targetRect.size());
+    if (cachedPhoto.isNull()) {
+        // stretch the last copy while transforming or rescaling in background
+        QPixmap lastPhoto = m_photo->lastScaled();
+        if (!lastPhoto.isNull()) {
+            if (!beingTransformed())
+                startRescale(targetRect.size());
+            painter->drawPixmap(targetRect, lastPhoto);
+            return;
+        }
+        // nothing to show meanwhile: stretch the nearest level of the
+        // pyramid while transforming, or rescale now
+        if (beingTransformed()) {
+            painter->drawImage(targetRect, m_photo->scaleSource(targetRect.size()));
+            return;
+        }
+        cachedPhoto = m_photo->smoothScaled(targetRect.size());
     }
+    painter->setRenderHints(QPainter::SmoothPixmapTransform);
+    painter->drawPixmap(targetRect.topLeft(), cachedPhoto);
 
 #if QT_VERSION >= 0x040500
 //    if (m_opaquePhoto)
 //        painter->setCompositionMode(QPainter::CompositionMode_SourceOver);
 #endif
 }
+
+TiledImage * PictureContent::tiledPhoto() const
+{
+    if (!m_photo || !m_photo->isReduced() || !TiledImage::isLarge(m_photo->fullSize()))
+        return 0;
+    if (!m_tiledPhoto)
+        m_tiledPhoto = new TiledImage(m_filePath);
+    return m_tiledPhoto->isNull() ? 0 : m_tiledPhoto;
+}
+
+void PictureContent::startRescale(const QSize & size)
+{
+    // already on it
+    if (m_rescaleWatcher && m_rescaleSize == size && m_rescaleGeneration == m_photoGeneration)
+        return;
+
+    // a stale job can't be stopped: it finishes unheard, while the latest
+    // size (of the latest photo) starts right away
+    delete m_rescaleWatcher;
+    m_rescaleWatcher = new QFutureWatcher<QImage>();
+    connect(m_rescaleWatcher, SIGNAL(finished()), this, SLOT(slotRescaled()));
+    m_rescaleSize = size;
+    m_rescaleGeneration = m_photoGeneration;
+    m_rescaleWatcher->setFuture(QtConcurrent::run(&CPixmap::scaleImage, m_photo->scaleSource(size), size));
+}
+
+void PictureContent::slotRescaled()
+{
+    if (!m_rescaleWatcher || sender() != m_rescaleWatcher)
+        return;
+    const QImage scaled = m_rescaleWatcher->result();
+    m_rescaleWatcher->deleteLater();
+    m_rescaleWatcher = 0;
+
+    // drop the results of a different photo or size, and paint again
+    if (m_photo && m_rescaleGeneration == m_photoGeneration && m_rescaleSize == contentsRect().size()) {
+        m_photo->setScaled(m_rescaleSize, scaled);
+        GFX_CHANGED();
+    }
+    update();
+}
@@ -16,8 +16,12 @@
 #define __PictureContent_h__
 
 #include "AbstractContent.h"
-struct CEffect;
+#include "effects/Effect.h"
+#include <QFutureWatcher>
+#include <QImage>
+#include <QList>
 class CPixmap;
+class TiledImage;
 
 /**
     \brief Transformable picture, with lots of gadgets
@@ -30,7 +34,30 @@ class PictureContent : public AbstractContent
         ~PictureContent();
 
         bool loadPhoto(const QString & fileName, bool keepRatio = false, bool setName = false);
+
+        // asynchronous loading (see PictureLoader): show a placeholder (the
+        // EXIF thumbnail if there's one), then set the pixels decoded
+        // elsewhere (a null image fails as loadPhoto), possibly reduced from
+        // the 'fullSize' of the file
+        void showPlaceholder(const QString & fileName);
+        bool loadDecodedPhoto(const QString & fileName, const QImage & image, const QSize & fullSize, bool keepRatio = false, bool setName = false);
+
+        // show a small copy (e.g. a thumbnail) until loadDecodedPhoto upgrades
+        // it in place, keeping the effects, the ratio and the name
+        bool loadPreviewPhoto(const QString & fileName, const QImage & preview, const QSize & fullSize, bool keepRatio = false, bool setName = false);
+        bool hasPreviewPhoto() const;
+        bool isPlaceholder() const;
+
+        // effects (kept aside while a placeholder, applied when the photo arrives)
         void addEffect(const CEffect & effect);
+        void setEffects(const QList<CEffect> & effects);
+
+        // effects computed outside the GUI thread (see EffectBatch)
+        QList<CEffect> effects() const;
+        QImage effectsBase(const QList<CEffect> & effects, QList<CEffect> * tail) const;
+        void setEffectsResult(const QList<CEffect> & effects, const QImage & result);
+        QString filePath() const;
+        qreal effectsScale() const;
 
         // ::AbstractContent
         bool fromXml(QDomElement & parentElement);
@@ -49,10 +76,26 @@ class PictureContent : public AbstractContent
         void flipVertically();
 
     private:
+        bool setPhoto(const QString & fileName, const QImage & image, const QSize & fullSize, bool keepRatio, bool setName, bool preview);
+        void setNameFromFile(const QString & fileName);
+        void startRescale(const QSize & size);
+        TiledImage * tiledPhoto() const;
         QString     m_filePath;
         CPixmap *   m_photo;
-        QPixmap     m_cachedPhoto;
+        mutable TiledImage * m_tiledPhoto;  // for the huge files, on demand
+        int         m_photoGeneration;
         bool        m_opaquePhoto;
+        bool        m_placeholder;
+        bool        m_previewPhoto;
+        QList<CEffect> m_pendingEffects;
+
+        // smooth rescale of the photo in the thread pool, for the latest size
+        QFutureWatcher<QImage> * m_rescaleWatcher;
+        QSize       m_rescaleSize;
+        int         m_rescaleGeneration;
+
+    private Q_SLOTS:
+        void slotRescaled();
 };
 
 #endif
@@ -17,6 +17,7 @@
 #include "GlowEffectDialog.h"
 #include "ui_PictureProperties.h"
 #include <QGraphicsSceneMouseEvent>
+#include <QInputDialog>
 #include <QListWidgetItem>
 #include <QSettings>
 
@@ -46,6 +47,15 @@ PictureProperties::PictureProperties(PictureContent * pictureContent, QGraphicsI
     glow->setData(Qt::UserRole, CEffect::Glow);
     QListWidgetItem *sepia = new QListWidgetItem(QIcon(":/data/effects-icons/sepia-effect.png"), tr("Sepia"), m_pictureUi->effectsList);
     sepia->setData(Qt::UserRole, CEffect::Sepia);
+    QListWidgetItem *brightness = new QListWidgetItem(QIcon(":/data/effects-icons/brightness-effect.png"), tr("Brightness"), m_pictureUi->effectsList);
+    brightness->setToolTip(tr("Make the picture lighter or darker"));
+    brightness->setData(Qt::UserRole, CEffect::Brightness);
+    QListWidgetItem *contrast = new QListWidgetItem(QIcon(":/data/effects-icons/contrast-effect.png"), tr("Contrast"), m_pictureUi->effectsList);
+    contrast->setToolTip(tr("Increase or reduce the contrast"));
+    contrast->setData(Qt::UserRole, CEffect::Contrast);
+    QListWidgetItem *gamma = new QListWidgetItem(QIcon(":/data/effects-icons/gamma-effect.png"), tr("Gamma"), m_pictureUi->effectsList);
+    gamma->setToolTip(tr("Lighten or darken the midtones"));
+    gamma->setData(Qt::UserRole, CEffect::Gamma);
 
     connect(m_pictureUi->invertButton, SIGNAL(clicked()), m_pictureContent, SIGNAL(flipVertically()));
     connect(m_pictureUi->flipButton, SIGNAL(clicked()), m_pictureContent, SIGNAL(flipHorizontally()));
@@ -84,6 +94,17 @@ void PictureProperties::on_effectsList_itemActivated(QListWidgetItem * item)
         param = (qreal)dialog.currentRadius();
     }
 
+    // ask the amount for the levels effects
+    bool ok = true;
+    if (effect == CEffect::Brightness)
+        param = (qreal)QInputDialog::getInteger(0, tr("Brightness"), tr("Levels to add (negative to darken):"), 30, -255, 255, 5, &ok);
+    else if (effect == CEffect::Contrast)
+        param = (qreal)QInputDialog::getInteger(0, tr("Contrast"), tr("Contrast change, in percent:"), 20, -100, 100, 5, &ok);
+    else if (effect == CEffect::Gamma)
+        param = QInputDialog::getDouble(0, tr("Gamma"), tr("Gamma (above 1 lightens, below 1 darkens):"), 1.5, 0.1, 10.0, 2, &ok);
+    if (!ok)
+        return;
+
     // apply the effect
     m_currentEffect = CEffect((CEffect::Effect)effect, param);
     emit applyEffect(m_currentEffect, false);
@@ -62,6 +62,8 @@ QString TextContent::toHtml() const
 void TextContent::setHtml(const QString & htmlCode)
 {
     m_text->setHtml(htmlCode);
+    update();
+    GFX_CHANGED();
 }
 
 bool TextContent::fromXml(QDomElement & pe)
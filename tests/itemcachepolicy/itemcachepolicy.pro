@@ -0,0 +1,53 @@
+# ItemCachePolicy test: a cached content exposed again counts as a hit, one
+# repainted after a graphics change as a miss. Build and run it on its own:
+#   cd tests/itemcachepolicy && qmake && make && ./itemcachepolicy-test
+TEMPLATE = app
+TARGET = itemcachepolicy-test
+CONFIG += console qtestlib
+CONFIG -= app_bundle
+DEPENDPATH += . \
+    ../..
+INCLUDEPATH += ../..
+MOC_DIR = .build
+OBJECTS_DIR = .build
+RCC_DIR = .build
+UI_DIR = .build
+QT = core \
+    gui \
+    svg \
+    network \
+    xml
+
+# Input: the contents and what they link to
+HEADERS += ../../3rdparty/gsuggest.h \
+    ../../CPixmap.h \
+    ../../ExifThumbnail.h \
+    ../../GlowEffectDialog.h \
+    ../../GlowEffectWidget.h \
+    ../../ImageCache.h \
+    ../../ItemCachePolicy.h \
+    ../../RenderSnapshot.h \
+    ../../ScanlineReader.h \
+    ../../ThumbnailCache.h \
+    ../../TiledImage.h
+SOURCES += main.cpp \
+    ../../3rdparty/gsuggest.cpp \
+    ../../CPixmap.cpp \
+    ../../ExifThumbnail.cpp \
+    ../../GlowEffectDialog.cpp \
+    ../../GlowEffectWidget.cpp \
+    ../../ImageCache.cpp \
+    ../../ItemCachePolicy.cpp \
+    ../../RenderSnapshot.cpp \
+    ../../ScanlineReader.cpp \
+    ../../ThumbnailCache.cpp \
+    ../../TiledImage.cpp
+FORMS += ../../GlowEffectDialog.ui
+RESOURCES += ../../fotowall.qrc
+
+# Sub-Components
+include(../../items/items.pri)
+include(../../frames/frames.pri)
+include(../../effects/effects.pri)
+include(../../3rdparty/richtextedit/richtextedit.pri)
+include(../../3rdparty/videocapture/videocapture.pri)
@@ -0,0 +1,103 @@
+/***************************************************************************
+ *                                                                         *
+ *   This file is part of the FotoWall project,                            *
+ *       http://code.google.com/p/fotowall                                 *
+ *                                                                         *
+ *   Copyright (C) 2009 by Enrico Ros <enrico.ros@gmail.com>               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "ItemCachePolicy.h"
+#include "RenderOpts.h"
+#include "items/AbstractContent.h"
+#include <QGraphicsScene>
+#include <QGraphicsView>
+#include <QPaintEvent>
+#include <QtTest>
+
+// the defaults of main.cpp
+bool RenderOpts::LastMirrorEnabled = true;
+bool RenderOpts::HQRendering = false;
+bool RenderOpts::FirstRun = false;
+QColor RenderOpts::hiColor;
+
+// a content painting just its frame, whose graphics can be changed
+class TestContent : public AbstractContent
+{
+    public:
+        TestContent(QGraphicsScene * scene)
+            : AbstractContent(scene)
+        {
+        }
+
+        void changeGraphics()
+        {
+            GFX_CHANGED();
+        }
+};
+
+// reports its exposes to the policy, as the view of FotoWall
+class TestView : public QGraphicsView
+{
+    public:
+        TestView(QGraphicsScene * scene)
+            : QGraphicsView(scene)
+        {
+        }
+
+    protected:
+        void paintEvent(QPaintEvent * event)
+        {
+            ItemCachePolicy * cachePolicy = ItemCachePolicy::instance();
+            cachePolicy->beginExpose(items(event->rect()));
+            QGraphicsView::paintEvent(event);
+            cachePolicy->endExpose();
+        }
+};
+
+class TestItemCachePolicy : public QObject
+{
+    Q_OBJECT
+    private Q_SLOTS:
+        void exposeCounts();
+};
+
+void TestItemCachePolicy::exposeCounts()
+{
+    QGraphicsScene scene(0, 0, 400, 300);
+    TestContent * content = new TestContent(&scene);
+    content->setPos(200, 150);
+    ItemCachePolicy * cachePolicy = ItemCachePolicy::instance();
+    cachePolicy->addContent(content);
+    QCOMPARE(content->cacheMode(), QGraphicsItem::DeviceCoordinateCache);
+
+    // the first paint fills the cache
+    TestView view(&scene);
+    view.resize(400, 300);
+    view.show();
+    QTest::qWaitForWindowShown(&view);
+    QApplication::processEvents();
+
+    // exposed again, the content comes from its cache
+    cachePolicy->resetCounters();
+    view.viewport()->repaint();
+    QCOMPARE(cachePolicy->hits(), 1);
+    QCOMPARE(cachePolicy->misses(), 0);
+
+    // a graphics change drops the cache: the next expose paints the content
+    content->changeGraphics();
+    QCOMPARE(cachePolicy->invalidations(), 1);
+    view.viewport()->repaint();
+    QCOMPARE(cachePolicy->hits(), 1);
+    QCOMPARE(cachePolicy->misses(), 1);
+
+    cachePolicy->removeContent(content);
+}
+
+QTEST_MAIN(TestItemCachePolicy)
+#include "main.moc"
@@ -0,0 +1,157 @@
+/***************************************************************************
+ *                                                                         *
+ *   This file is part of the FotoWall project,                            *
+ *       http://code.google.com/p/fotowall                                 *
+ *                                                                         *
+ *   Copyright (C) 2009 by Enrico Ros <enrico.ros@gmail.com>               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "RenderSnapshot.h"
+#include <QLinearGradient>
+#include <QPainter>
+#include <QPixmap>
+#include <QRadialGradient>
+#include <QtTest>
+
+static const QSize SIZE(301, 233);
+
+// what Desk::renderDevice() paints with, on the device to compare
+static void paintScene(QPaintDevice * device, int scene)
+{
+    QPainter p(device);
+    p.setRenderHints(QPainter::Antialiasing | QPainter::TextAntialiasing | QPainter::SmoothPixmapTransform);
+    switch (scene) {
+        case 0: // antialiased shapes, under a rotation
+            p.fillRect(QRect(0, 0, SIZE.width(), SIZE.height()), QColor(250, 240, 220));
+            p.setPen(QPen(Qt::darkBlue, 3.5));
+            p.setBrush(QColor(200, 40, 40, 160));
+            p.drawEllipse(QRectF(20.3, 15.7, 170.2, 120.9));
+            p.translate(150, 120);
+            p.rotate(27);
+            p.drawRect(QRectF(-60.5, -30.25, 121, 60.5));
+            p.drawLine(QPointF(-140, -90), QPointF(130, 95));
+            break;
+        case 1: { // gradients
+            QLinearGradient linear(0, 0, SIZE.width(), SIZE.height());
+            linear.setColorAt(0, Qt::white);
+            linear.setColorAt(0.4, QColor(30, 90, 200));
+            linear.setColorAt(1, Qt::black);
+            p.fillRect(QRect(0, 0, SIZE.width(), SIZE.height()), linear);
+            QRadialGradient radial(QPointF(0, 0), 80);
+            radial.setColorAt(0, QColor(255, 255, 0, 220));
+            radial.setColorAt(1, QColor(255, 0, 0, 0));
+            p.translate(180.5, 90.25);
+            p.rotate(-13);
+            p.setPen(Qt::NoPen);
+            p.setBrush(radial);
+            p.drawEllipse(QPointF(0, 0), 95.0, 70.0);
+            } break;
+        case 2: { // clips replaced, intersected, disabled and enabled back
+            p.setClipRect(QRect(10, 10, 220, 180));
+            p.fillRect(QRect(0, 0, SIZE.width(), SIZE.height()), Qt::gray);
+            p.save();
+            QPainterPath round;
+            round.addEllipse(QRectF(40.5, 30.5, 200, 150));
+            p.setClipPath(round, Qt::IntersectClip);
+            p.fillRect(QRect(0, 0, SIZE.width(), SIZE.height()), QColor(20, 160, 90));
+            p.restore();
+            p.setClipping(false);
+            p.fillRect(QRect(200, 150, 100, 80), QColor(0, 0, 0, 128));
+            p.setClipping(true);
+            p.fillRect(QRect(0, 100, SIZE.width(), 40), Qt::blue);
+            p.setClipRegion(QRegion(QRect(150, 0, 100, SIZE.height())), Qt::ReplaceClip);
+            p.setBrush(Qt::yellow);
+            p.drawEllipse(QRectF(120.5, 60.5, 160, 120));
+            } break;
+        case 3: { // images, scaled, rotated and tiled
+            QImage image(37, 23, QImage::Format_ARGB32);
+            for (int y = 0; y < image.height(); ++y)
+                for (int x = 0; x < image.width(); ++x)
+                    image.setPixel(x, y, qRgba(x * 7, y * 11, (x * y) % 256, 128 + (x + y) % 128));
+            p.drawImage(QRectF(5.5, 7.25, 170.4, 130.7), image);
+            p.drawTiledPixmap(QRect(180, 10, 110, 90), QPixmap::fromImage(image), QPoint(5, 3));
+            p.translate(150, 170);
+            p.rotate(33);
+            p.drawPixmap(QRectF(-60, -25, 120, 50), QPixmap::fromImage(image), QRectF(2, 2, 30, 18));
+            } break;
+        case 4: // text, translucent
+            p.fillRect(QRect(0, 0, SIZE.width(), SIZE.height()), Qt::white);
+            p.setPen(Qt::black);
+            p.setFont(QFont("Sans Serif", 17));
+            p.drawText(QPointF(12.5, 40.5), "FotoWall snapshot");
+            p.setOpacity(0.6);
+            p.setPen(Qt::darkRed);
+            p.rotate(8);
+            p.setFont(QFont("Serif", 23, QFont::Bold, true));
+            p.drawText(QPointF(30, 110), "The quick brown fox");
+            break;
+    }
+    p.end();
+}
+
+static int differingPixels(const QImage & a, const QImage & b)
+{
+    if (a.size() != b.size())
+        return -1;
+    int count = 0;
+    for (int y = 0; y < a.height(); ++y) {
+        const QRgb * pa = (const QRgb *)a.scanLine(y);
+        const QRgb * pb = (const QRgb *)b.scanLine(y);
+        for (int x = 0; x < a.width(); ++x)
+            if (pa[x] != pb[x])
+                ++count;
+    }
+    return count;
+}
+
+class TestRenderSnapshot : public QObject
+{
+    Q_OBJECT
+    private Q_SLOTS:
+        void replayMatchesDirect_data();
+        void replayMatchesDirect();
+};
+
+void TestRenderSnapshot::replayMatchesDirect_data()
+{
+    QTest::addColumn<int>("scene");
+    QTest::addColumn<QRect>("area");
+    QTest::addColumn<int>("tileSide");
+
+    const char * names[] = { "shapes", "gradients", "clips", "images", "text" };
+    for (int scene = 0; scene < 5; ++scene) {
+        QTest::newRow(QByteArray(names[scene]) + " whole") << scene << QRect() << 0;
+        QTest::newRow(QByteArray(names[scene]) + " tiles") << scene << QRect() << 37;
+        QTest::newRow(QByteArray(names[scene]) + " band") << scene << QRect(0, 61, SIZE.width(), 53) << 29;
+        QTest::newRow(QByteArray(names[scene]) + " area") << scene << QRect(47, 33, 190, 150) << 64;
+    }
+}
+
+void TestRenderSnapshot::replayMatchesDirect()
+{
+    QFETCH(int, scene);
+    QFETCH(QRect, area);
+    QFETCH(int, tileSide);
+
+    QImage direct(SIZE, QImage::Format_ARGB32);
+    direct.fill(0);
+    paintScene(&direct, scene);
+
+    RenderSnapshot snapshot(SIZE);
+    paintScene(&snapshot, scene);
+    if (!snapshot.isExact())
+        QSKIP("the fonts lay the runs out differently: rasterized, not exact", SkipSingle);
+
+    const QImage replayed = snapshot.toImage(area, tileSide);
+    const QImage expected = area.isNull() ? direct : direct.copy(area);
+    QCOMPARE(differingPixels(replayed, expected), 0);
+}
+
+QTEST_MAIN(TestRenderSnapshot)
+#include "main.moc"
@@ -0,0 +1,21 @@
+# RenderSnapshot test: the tiled replay of a recording has the pixels of the
+# same painting done directly on an image. Build and run it on its own:
+#   cd tests/rendersnapshot && qmake && make && ./rendersnapshot-test
+TEMPLATE = app
+TARGET = rendersnapshot-test
+CONFIG += console qtestlib
+CONFIG -= app_bundle
+DEPENDPATH += . \
+    ../..
+INCLUDEPATH += ../..
+MOC_DIR = .build
+OBJECTS_DIR = .build
+QT = core \
+    gui
+
+# Input
+HEADERS += ../../ImageCache.h \
+    ../../RenderSnapshot.h
+SOURCES += main.cpp \
+    ../../ImageCache.cpp \
+    ../../RenderSnapshot.cpp